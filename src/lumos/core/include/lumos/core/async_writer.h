@@ -0,0 +1,75 @@
+#pragma once
+
+#include "lumos/core/color.h"
+#include "lumos/core/common.h"
+#include "lumos/core/imageio.h"
+
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace lumos {
+// writes images on background threads so that a renderer does not stall on
+// png/exr compression. Submitting takes ownership of the image (move it in to
+// avoid the copy) and blocks while `max_pending` images are queued or being
+// written, so memory stays bounded when the disk is slower than the producer.
+// Errors are reported through the returned future.
+class AsyncImageWriter {
+public:
+  explicit AsyncImageWriter(int workers = 1, size_t max_pending = 4);
+
+  std::future<void> SavePng(const std::filesystem::path &output,
+                            ImageData4u8 pic);
+  std::future<void> SaveExr(const std::filesystem::path &output,
+                            ImageData4f pic, const ExrSettings &settings = {});
+  // same as the block overload of lumos::SaveExr
+  std::future<void> SaveExr(const std::filesystem::path &output,
+                            int display_height, int display_width,
+                            int row_offset, int col_offset, ImageData4f block,
+                            const ExrSettings &settings = {});
+
+  // runs `write` on a worker with the same backpressure as the image writes.
+  // `write` and what it captures are destroyed before the future becomes
+  // ready, so callers holding on to futures do not hold on to images
+  std::future<void> Submit(std::function<void()> write);
+
+  // block until every submitted image has been written
+  void Wait();
+
+  // images queued or being written
+  size_t Pending() const;
+
+  AsyncImageWriter(const AsyncImageWriter &) = delete;
+  AsyncImageWriter &operator=(const AsyncImageWriter &) = delete;
+
+  // writes every remaining image before returning
+  ~AsyncImageWriter();
+
+private:
+  // the image is owned by `write` rather than by the shared state of the
+  // returned future, which lives as long as the caller keeps the future
+  struct Job {
+    std::function<void()> write;
+    std::promise<void> done;
+  };
+
+  // lets the workers drain the queue and joins them
+  void stop();
+  void workerLoop();
+
+  std::vector<std::thread> m_workers;
+  std::deque<Job> m_queue;
+  mutable std::mutex m_mutex;
+  std::condition_variable m_not_empty;
+  std::condition_variable m_not_full;
+  std::condition_variable m_idle;
+  size_t m_max_pending{};
+  size_t m_pending{};
+  bool m_stop{};
+};
+} // namespace lumos
@@ -0,0 +1,133 @@
+#pragma once
+
+#include "lumos/core/common.h"
+#include "lumos/core/image_buffer.h"
+
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace lumos {
+struct BufferPoolStats {
+  // Allocate() calls and how many of them reused a cached block
+  size_t requests{};
+  size_t hits{};
+  // bytes handed out and not yet returned, by size class
+  size_t bytes_in_use{};
+  // bytes of returned blocks kept for reuse
+  size_t bytes_cached{};
+  // highest bytes_in_use + bytes_cached, i.e. what the pool held from the
+  // system at any time
+  size_t peak_footprint{};
+
+  double HitRate() const {
+    return requests > 0 ? static_cast<double>(hits) / requests : 0.0;
+  }
+};
+
+// size class pool for transient image storage. Blocks are ALIGNMENT aligned
+// and rounded up to a size class (64 byte steps up to 4 KiB, then 4 classes
+// per power of two, at most 25% slack), returned blocks are kept per class
+// and handed out again, so repeated reads / writes / conversions of the same
+// frame size do not go back to the system allocator. At most
+// `max_cached_bytes` are kept, blocks returned beyond that are freed.
+// Thread safe
+class BufferPool {
+public:
+  static constexpr size_t ALIGNMENT = 64;
+
+  explicit BufferPool(size_t max_cached_bytes = DEFAULT_MAX_CACHED_BYTES);
+  ~BufferPool();
+  BufferPool(const BufferPool &) = delete;
+  BufferPool &operator=(const BufferPool &) = delete;
+
+  // the pool used by imageio, resampling and PlanarImage
+  static BufferPool &Global();
+
+  // never returns null for bytes > 0, throws std::bad_alloc like operator new
+  void *Allocate(size_t bytes);
+  // `bytes` must be the size passed to Allocate
+  void Deallocate(void *p, size_t bytes);
+
+  // free every cached block
+  void Trim();
+  void SetMaxCachedBytes(size_t bytes);
+  size_t GetMaxCachedBytes() const;
+
+  BufferPoolStats Stats() const;
+  // counters and peak restart from the current state
+  void ResetStats();
+
+  // the size a request of `bytes` is rounded up to
+  static size_t SizeClass(size_t bytes);
+
+private:
+  static constexpr size_t DEFAULT_MAX_CACHED_BYTES = size_t{1} << 30;
+
+  void trimTo(size_t bytes);
+
+  mutable std::mutex m_mutex;
+  std::map<size_t, std::vector<void *>> m_free;
+  size_t m_max_cached_bytes;
+  BufferPoolStats m_stats;
+};
+
+// uninitialized storage for `size` objects of T from a BufferPool, returned
+// to the pool on destruction. Meant for pixel types and other plain data,
+// no constructors or destructors are run
+template <typename T> class PooledBuffer {
+public:
+  PooledBuffer() = default;
+  explicit PooledBuffer(size_t size, BufferPool &pool = BufferPool::Global())
+      : m_pool(&pool), m_size(size) {
+    if (m_size > 0) {
+      m_data = static_cast<T *>(m_pool->Allocate(m_size * sizeof(T)));
+    }
+  }
+  ~PooledBuffer() { release(); }
+
+  PooledBuffer(PooledBuffer &&other) noexcept { *this = std::move(other); }
+  PooledBuffer &operator=(PooledBuffer &&other) noexcept {
+    if (this != &other) {
+      release();
+      m_pool = std::exchange(other.m_pool, nullptr);
+      m_data = std::exchange(other.m_data, nullptr);
+      m_size = std::exchange(other.m_size, 0);
+    }
+    return *this;
+  }
+  PooledBuffer(const PooledBuffer &) = delete;
+  PooledBuffer &operator=(const PooledBuffer &) = delete;
+
+  T *Data() { return m_data; }
+  const T *Data() const { return m_data; }
+  size_t Size() const { return m_size; }
+  T &operator[](size_t i) { return m_data[i]; }
+  const T &operator[](size_t i) const { return m_data[i]; }
+
+private:
+  void release() {
+    if (m_data) {
+      m_pool->Deallocate(m_data, m_size * sizeof(T));
+      m_data = nullptr;
+    }
+  }
+
+  BufferPool *m_pool{};
+  T *m_data{};
+  size_t m_size{};
+};
+
+// rows x cols uninitialized pixels from `pool`, accessed through View() like
+// any other ImageBuffer
+template <typename Pixel>
+ImageBuffer<Pixel> AllocatePooledImage(int rows, int cols,
+                                       BufferPool &pool = BufferPool::Global()) {
+  size_t bytes = static_cast<size_t>(rows) * cols * sizeof(Pixel);
+  BufferPool *p = &pool;
+  return ImageBuffer<Pixel>(static_cast<Pixel *>(p->Allocate(bytes)), rows,
+                            cols, [p, bytes](void *d) { p->Deallocate(d, bytes); });
+}
+} // namespace lumos
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "lumos/core/common.h"
+#include "lumos/core/geometry.h"
+#include "lumos/core/mesh.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace lumos {
+struct BvhSettings {
+  // centroid bins per axis the SAH is evaluated on
+  int bin_count = 16;
+  // nodes with more triangles are always split
+  int max_leaf_size = 4;
+  // SAH cost of a node visit and of a triangle test
+  float traversal_cost = 1.0f;
+  float intersection_cost = 1.0f;
+  // meshes with at least this many triangles get their top levels from the
+  // Morton order of the centroids (LBVH, Karras 2012) instead of the SAH,
+  // which needs no binning and no partitioning, 0 disables it
+  int lbvh_min_triangles = 1 << 20;
+};
+
+// 32 bytes, two per cache line
+struct BvhNode {
+  Bounds3f bounds;
+  // interior node: index of the first of its two adjacent children, leaf:
+  // index of its first triangle in Bvh::Triangles()
+  uint32_t offset;
+  // triangles of a leaf, 0 for an interior node
+  uint16_t count;
+  // split axis of an interior node, the first child lies on the lower side
+  uint16_t axis;
+
+  bool IsLeaf() const { return count > 0; }
+};
+
+// binary bounding volume hierarchy over the triangles of a mesh, split with
+// the surface area heuristic evaluated on centroid bins (Wald 2007). The mesh
+// is referenced, not copied, and has to outlive the Bvh.
+// The build is parallel: the top levels bin large nodes in parallel (or come
+// from the LBVH, see BvhSettings) and fork a task per child, subtrees of a few
+// thousand triangles are built by a single task each and spliced into the
+// node array at the end. The tree does not depend on the thread count. Build
+// time, SAH cost and memory are logged at info level
+class Bvh {
+public:
+  // traversal stack size, the build falls back to median splits well before
+  // the depth gets there
+  static constexpr int MAX_DEPTH = 128;
+
+  explicit Bvh(const TriangleMesh &mesh, const BvhSettings &settings = {});
+
+  // closest hit in (ray.t_min, ray.t_max), `hit` is left untouched on a miss
+  bool Intersect(const Ray &ray, RayHit *hit) const;
+  // any hit in (ray.t_min, ray.t_max), returns at the first one found
+  bool Occluded(const Ray &ray) const;
+
+  const TriangleMesh &Mesh() const { return *m_mesh; }
+  // node 0 is the root
+  const std::vector<BvhNode> &Nodes() const { return m_nodes; }
+  // triangle indices in leaf order
+  const std::vector<uint32_t> &Triangles() const { return m_triangles; }
+  Bounds3f Bounds() const;
+  int Depth() const { return m_depth; }
+  // expected cost of a random ray hitting the root, in units of the settings
+  // costs
+  float SahCost() const;
+  // bytes held by the nodes and the triangle indices
+  size_t MemoryBytes() const;
+
+private:
+  const TriangleMesh *m_mesh;
+  BvhSettings m_settings;
+  std::vector<BvhNode> m_nodes;
+  std::vector<uint32_t> m_triangles;
+  int m_depth = 0;
+};
+} // namespace lumos
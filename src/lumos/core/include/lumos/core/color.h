@@ -2,6 +2,15 @@
 
 #include "lumos/core/common.h"
 
+// lets Eigen use the OpenEXR half (not Eigen::half) as a scalar, arithmetic
+// goes through the implicit float conversion and is rounded back to half after
+// every operation
+namespace Eigen {
+template <> struct NumTraits<::half> : GenericNumTraits<::half> {
+  static inline ::half dummy_precision() { return ::half(1e-2f); }
+};
+} // namespace Eigen
+
 namespace lumos {
 template <typename Scalar, int Size>
 class Color : public Eigen::Vector<Scalar, Size> {
@@ -9,8 +18,15 @@ public:
   using Base = Eigen::Vector<Scalar, Size>;
   Color<Scalar, Size>(void) : Base() {}
 
-  Color<Scalar, Size>(Scalar r, Scalar g, Scalar b)
-      : Base(r, g, b, static_cast<Scalar>(1)) {}
+  // alpha is set to 1 for a 4 channel color
+  Color<Scalar, Size>(Scalar r, Scalar g, Scalar b) : Base() {
+    this->coeffRef(0) = r;
+    this->coeffRef(1) = g;
+    this->coeffRef(2) = b;
+    if constexpr (Size == 4) {
+      this->coeffRef(3) = static_cast<Scalar>(1);
+    }
+  }
 
   Color<Scalar, Size>(Scalar r, Scalar g, Scalar b, Scalar a)
       : Base(r, g, b, a) {}
@@ -90,9 +106,22 @@ inline Color<float, Size> ToFloat(const Color<uint8_t, Size> &c) {
   }
 }
 
+// relative luminance of linear Rec.709 / sRGB primaries
+template <int Size> inline float Luminance(const Color<float, Size> &c) {
+  return 0.2126f * c.r() + 0.7152f * c.g() + 0.0722f * c.b();
+}
+
 inline Imf::Rgba ToImfRgba(const Color4f &c) {
   return {c.r(), c.g(), c.b(), c.a()};
 }
 
 inline Color4f ToColor4f(const Imf::Rgba &c) { return {c.r, c.g, c.b, c.a}; }
+
+// Color4h has the memory layout of Imf::Rgba, bulk conversions are in
+// convert.h
+inline Imf::Rgba ToImfRgba(const Color4h &c) {
+  return {c.r(), c.g(), c.b(), c.a()};
+}
+
+inline Color4h ToColor4h(const Imf::Rgba &c) { return {c.r, c.g, c.b, c.a}; }
 } // namespace lumos
\ No newline at end of file
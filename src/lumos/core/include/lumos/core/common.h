@@ -52,11 +52,13 @@ using Color3f = Color<float, 3>;
 using Color4f = Color<float, 4>;
 using Color3u8 = Color<uint8_t, 3>;
 using Color4u8 = Color<uint8_t, 4>;
+using Color4h = Color<half, 4>;
 
 // 这个只能算 image_data
 template <typename Pixel>
 using ImageData =
     Eigen::Array<Pixel, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+using ImageData1f = ImageData<float>;
 using ImageData4h = ImageData<Imf::Rgba>;
 using ImageData3u8 = ImageData<Color3u8>;
 using ImageData4u8 = ImageData<Color4u8>;
@@ -64,6 +66,7 @@ using ImageData3f = ImageData<Color3f>;
 using ImageData4f = ImageData<Color4f>;
 
 template <typename Pixel> using ImageDataView = Eigen::Map<ImageData<Pixel>>;
+using ImageDataView1f = ImageDataView<float>;
 using ImageDataView4h = ImageDataView<Imf::Rgba>;
 using ImageDataView3u8 = ImageDataView<Color3u8>;
 using ImageDataView4u8 = ImageDataView<Color4u8>;
@@ -77,6 +80,8 @@ template <typename T> inline T Clamp(T value, T min, T max) {
   return std::min(std::max(value, min), max);
 }
 
+// registers the "lumos" logger once. Without `sinks` it writes to stdout with
+// the default pattern plus the thread name, given sinks keep their formatters
 std::shared_ptr<spdlog::logger>
 SetupLogger(const std::vector<spdlog::sink_ptr> &sinks);
 std::filesystem::path GetDataPath(const std::filesystem::path& path);
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "lumos/core/common.h"
+
+#include <cstddef>
+
+namespace lumos {
+// bulk half <-> float conversion of `count` pixels, F16C is used when the cpu
+// supports it (checked once at runtime), otherwise the Imath scalar path.
+// `dst` may alias the back half of a row twice as wide as `src` (the layout
+// used by ReadExr for in place decoding), every pixel is loaded before the
+// store that could overwrite it
+void HalfToFloat(const Imf::Rgba *src, Color4f *dst, size_t count);
+void FloatToHalf(const Color4f *src, Imf::Rgba *dst, size_t count);
+
+// Color4h shares the layout of Imf::Rgba and the kernels above
+void HalfToFloat(const Color4h *src, Color4f *dst, size_t count);
+void FloatToHalf(const Color4f *src, Color4h *dst, size_t count);
+
+// dst += weight * src for `count` pixels, summed in float and for a half `dst`
+// rounded once per pixel. For AOV and preview buffers kept at 8 bytes per
+// pixel, `src` and `dst` must not overlap
+void Accumulate(const Color4h *src, float weight, Color4f *dst, size_t count);
+void Accumulate(const Color4f *src, float weight, Color4h *dst, size_t count);
+void Accumulate(const Color4h *src, float weight, Color4h *dst, size_t count);
+
+// the same for 3 channel pixels, alpha is dropped / set to 1. `src` and `dst`
+// must not overlap
+void HalfToFloat(const Imf::Rgba *src, Color3f *dst, size_t count);
+void FloatToHalf(const Color3f *src, Imf::Rgba *dst, size_t count);
+
+// single channel pixels: Luminance() of the RGB channels (the Y of a
+// luminance only file, which the Rgba interface reads as R = G = B = Y), and
+// gray pixels with alpha 1
+void HalfToLuminance(const Imf::Rgba *src, float *dst, size_t count);
+void LuminanceToHalf(const float *src, Imf::Rgba *dst, size_t count);
+
+// half <-> 8-bit sRGB, through a small float buffer
+void HalfToSrgb8(const Imf::Rgba *src, Color4u8 *dst, size_t count);
+void Srgb8ToHalf(const Color4u8 *src, Imf::Rgba *dst, size_t count);
+
+// whole image conversion, rows are converted in parallel
+void ToImageData4f(const ImageData4h &src, ImageData4f *dst);
+void ToImageData4h(const ImageData4f &src, ImageData4h *dst);
+
+// bulk sRGB encode/decode, alpha is passed through (and only quantized for
+// 8-bit). The per color ToSrgb/ToLinearRgb in color.h stay the reference:
+// - decode uses a 256 entry table built from ToLinearRgb, it is exact
+// - encode replaces std::pow by an exponent table and a linearly
+//   interpolated 128 segment mantissa table, the max error against ToSrgb is
+//   below 5e-6 relative (below 2e-6 absolute on [0, 1]), inf stays inf and
+//   NaN encodes like ToSrgb does
+// - 8-bit encode equals ToUint8(ToSrgb(c)) except for values within the error
+//   above of a quantization step
+void LinearToSrgb(const Color4f *src, Color4f *dst, size_t count);
+void LinearToSrgb8(const Color4f *src, Color4u8 *dst, size_t count);
+void SrgbToLinear(const Color4u8 *src, Color4f *dst, size_t count);
+
+void ToSrgb(const ImageData4f &src, ImageData4f *dst);
+void ToSrgbUint8(const ImageData4f &src, ImageData4u8 *dst);
+void ToLinearRgb(const ImageData4u8 &src, ImageData4f *dst);
+
+// clamp to [0, 1] and round to the nearest 8-bit value (the per color ToUint8
+// truncates), no transfer function is applied
+void QuantizeUint8(const ImageData4f &src, ImageData4u8 *dst);
+
+// true if the F16C kernels are selected
+bool HasF16c();
+} // namespace lumos
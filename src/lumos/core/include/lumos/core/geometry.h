@@ -0,0 +1,152 @@
+#pragma once
+
+#include "lumos/core/common.h"
+#include "lumos/core/vector.h"
+
+#include <Eigen/Geometry>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+namespace lumos {
+struct Ray {
+  Vector3f origin;
+  // not necessarily normalized, t is measured in units of it
+  Vector3f direction;
+  // the valid segment, the open interval (t_min, t_max): a hit at exactly
+  // t_min or t_max does not count
+  float t_min = 0.0f;
+  float t_max = std::numeric_limits<float>::infinity();
+
+  Ray() = default;
+  Ray(const Vector3f &origin, const Vector3f &direction, float t_min = 0.0f,
+      float t_max = std::numeric_limits<float>::infinity())
+      : origin(origin), direction(direction), t_min(t_min), t_max(t_max) {}
+
+  Vector3f operator()(float t) const { return origin + t * direction; }
+};
+
+constexpr uint32_t INVALID_INDEX = std::numeric_limits<uint32_t>::max();
+
+struct RayHit {
+  float t = std::numeric_limits<float>::infinity();
+  // barycentric coordinates of the hit point, p = (1 - u - v) p0 + u p1 + v p2
+  float u = 0.0f;
+  float v = 0.0f;
+  uint32_t triangle = INVALID_INDEX;
+
+  bool Valid() const { return triangle != INVALID_INDEX; }
+};
+
+// axis aligned box, empty (min > max) when default constructed
+struct Bounds3f {
+  Vector3f min = Vector3f::Constant(std::numeric_limits<float>::infinity());
+  Vector3f max = Vector3f::Constant(-std::numeric_limits<float>::infinity());
+
+  Bounds3f() = default;
+  Bounds3f(const Vector3f &min, const Vector3f &max) : min(min), max(max) {}
+
+  bool IsEmpty() const { return (min.array() > max.array()).any(); }
+
+  void Extend(const Vector3f &p) {
+    min = min.cwiseMin(p);
+    max = max.cwiseMax(p);
+  }
+  void Extend(const Bounds3f &b) {
+    min = min.cwiseMin(b.min);
+    max = max.cwiseMax(b.max);
+  }
+
+  Vector3f Diagonal() const { return max - min; }
+  Vector3f Centroid() const { return 0.5f * (min + max); }
+
+  // 0 for an empty box
+  float SurfaceArea() const {
+    if (IsEmpty()) {
+      return 0.0f;
+    }
+    Vector3f d = Diagonal();
+    return 2.0f * (d.x() * d.y() + d.y() * d.z() + d.z() * d.x());
+  }
+
+  // axis of the longest side
+  int MaxExtent() const {
+    int axis;
+    Diagonal().maxCoeff(&axis);
+    return axis;
+  }
+
+  // position of `p` relative to the box, 0 at min and 1 at max
+  Vector3f Offset(const Vector3f &p) const {
+    Vector3f o = p - min;
+    Vector3f d = Diagonal();
+    for (int i = 0; i < 3; ++i) {
+      if (d[i] > 0.0f) {
+        o[i] /= d[i];
+      }
+    }
+    return o;
+  }
+
+  // slab test against [t_min, t_max], `inv_direction` is the per component
+  // reciprocal of the ray direction (inf for a zero component)
+  bool Intersect(const Vector3f &origin, const Vector3f &inv_direction,
+                 float t_min, float t_max) const {
+    for (int i = 0; i < 3; ++i) {
+      float t0 = (min[i] - origin[i]) * inv_direction[i];
+      float t1 = (max[i] - origin[i]) * inv_direction[i];
+      if (inv_direction[i] < 0.0f) {
+        std::swap(t0, t1);
+      }
+      // NaN (0 * inf on a slab plane) keeps the current interval
+      t_min = t0 > t_min ? t0 : t_min;
+      t_max = t1 < t_max ? t1 : t_max;
+      if (t_min > t_max) {
+        return false;
+      }
+    }
+    return true;
+  }
+};
+
+inline Bounds3f Union(const Bounds3f &a, const Bounds3f &b) {
+  return {a.min.cwiseMin(b.min), a.max.cwiseMax(b.max)};
+}
+
+// Moller-Trumbore on the edges e1 = p1 - p0 and e2 = p2 - p0, a hit in
+// (t_min, t_max) sets `t`, `u` and `v` (see RayHit). Both faces are hit
+inline bool IntersectTriangleEdges(const Ray &ray, const Vector3f &p0,
+                                   const Vector3f &e1, const Vector3f &e2,
+                                   float t_max, float *t, float *u, float *v) {
+  Vector3f p = ray.direction.cross(e2);
+  float det = e1.dot(p);
+  if (det == 0.0f || !std::isfinite(det)) {
+    return false;
+  }
+  float inv_det = 1.0f / det;
+  Vector3f s = ray.origin - p0;
+  float b1 = s.dot(p) * inv_det;
+  if (b1 < 0.0f || b1 > 1.0f) {
+    return false;
+  }
+  Vector3f q = s.cross(e1);
+  float b2 = ray.direction.dot(q) * inv_det;
+  if (b2 < 0.0f || b1 + b2 > 1.0f) {
+    return false;
+  }
+  float hit_t = e2.dot(q) * inv_det;
+  if (!(hit_t > ray.t_min && hit_t < t_max)) {
+    return false;
+  }
+  *t = hit_t;
+  *u = b1;
+  *v = b2;
+  return true;
+}
+
+inline bool IntersectTriangle(const Ray &ray, const Vector3f &p0,
+                              const Vector3f &p1, const Vector3f &p2,
+                              float t_max, float *t, float *u, float *v) {
+  return IntersectTriangleEdges(ray, p0, p1 - p0, p2 - p0, t_max, t, u, v);
+}
+} // namespace lumos
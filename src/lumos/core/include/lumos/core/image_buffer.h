@@ -0,0 +1,41 @@
+#pragma once
+
+#include "lumos/core/common.h"
+
+#include <functional>
+
+namespace lumos {
+// image storage adopting a buffer allocated elsewhere (e.g. by a decoder),
+// the buffer is released with `deleter`, pixels are accessed through View()
+// without any copy
+template <typename Pixel> class ImageBuffer {
+public:
+  using Deleter = std::function<void(void *)>;
+  using MapType = ImageDataView<Pixel>;
+  using ConstMapType = Eigen::Map<const ImageData<Pixel>>;
+
+  ImageBuffer() = default;
+  ImageBuffer(Pixel *data, int rows, int cols, Deleter deleter)
+      : m_data(data, [deleter](Pixel *p) { deleter(p); }), m_rows(rows),
+        m_cols(cols) {}
+
+  MapType View() { return MapType(m_data.get(), m_rows, m_cols); }
+  ConstMapType View() const {
+    return ConstMapType(m_data.get(), m_rows, m_cols);
+  }
+
+  Pixel *Data() { return m_data.get(); }
+  const Pixel *Data() const { return m_data.get(); }
+  int Rows() const { return m_rows; }
+  int Cols() const { return m_cols; }
+  explicit operator bool() const noexcept { return static_cast<bool>(m_data); }
+
+private:
+  std::unique_ptr<Pixel, std::function<void(Pixel *)>> m_data;
+  int m_rows{};
+  int m_cols{};
+};
+
+using ImageBuffer4u8 = ImageBuffer<Color4u8>;
+using ImageBuffer4f = ImageBuffer<Color4f>;
+} // namespace lumos
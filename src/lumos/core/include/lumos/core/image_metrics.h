@@ -0,0 +1,64 @@
+#pragma once
+
+#include "lumos/core/color.h"
+#include "lumos/core/common.h"
+
+#include <filesystem>
+
+namespace lumos {
+// image difference metrics for render regression tests. `image` and
+// `reference` are linear RGB of the same size, alpha is ignored. Every metric
+// runs rows in parallel, row sums are added up in row order so the result
+// does not depend on the thread count. When `error_map` is given it receives
+// the per pixel error the metric is the mean of (see ErrorHeatmap)
+
+// mean squared error over the RGB channels
+double Mse(const ImageData4f &image, const ImageData4f &reference,
+           ImageData1f *error_map = nullptr);
+
+// squared error relative to the reference, (x - y)^2 / (y^2 + RELMSE_EPSILON),
+// comparable across exposures of HDR renders
+constexpr float RELMSE_EPSILON = 1e-2f;
+double RelMse(const ImageData4f &image, const ImageData4f &reference,
+              ImageData1f *error_map = nullptr);
+
+// 10 * log10(peak^2 / Mse), infinite for identical images
+double Psnr(const ImageData4f &image, const ImageData4f &reference,
+            float peak = 1.0f);
+
+struct SsimSettings {
+  // of the gaussian window, truncated at 3 sigma
+  float sigma = 1.5f;
+  float k1 = 0.01f;
+  float k2 = 0.03f;
+  // value range of the inputs, 1 for display referred images
+  float dynamic_range = 1.0f;
+};
+
+// structural similarity (Wang et al. 2004) of the luminance with a separable
+// gaussian window, 1 for identical images. The map holds the local SSIM
+double Ssim(const ImageData4f &image, const ImageData4f &reference,
+            ImageData1f *error_map = nullptr, const SsimSettings &settings = {});
+
+struct FlipSettings {
+  // observer distance, 67 is a 0.7 m view of a 24" 4K monitor
+  float pixels_per_degree = 67.0f;
+};
+
+// perceptual difference in [0, 1] modeled on LDR-FLIP (Andersson et al.
+// 2020): both images (clamped to [0, 1]) are filtered by gaussian
+// approximations of the achromatic and chromatic contrast sensitivity in
+// YCxCz, compared with the HyAB distance in Hunt adjusted L*a*b* and the
+// color error is amplified where the edge content differs. Point features are
+// not detected, so isolated single pixel differences score lower than in FLIP
+double Flip(const ImageData4f &image, const ImageData4f &reference,
+            ImageData1f *error_map = nullptr, const FlipSettings &settings = {});
+
+// per pixel error scaled by 1 / max_error and mapped through the magma color
+// map (black = no error), linear RGB so that it shows up as intended in an EXR
+// viewer
+void ErrorHeatmap(const ImageData1f &error_map, ImageData4f *heatmap,
+                  float max_error = 1.0f);
+void SaveErrorHeatmap(const std::filesystem::path &output,
+                      const ImageData1f &error_map, float max_error = 1.0f);
+} // namespace lumos
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "lumos/core/color.h"
+#include "lumos/core/common.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace lumos {
+struct ImageStatsSettings {
+  // luminance histogram over [histogram_min, histogram_max], values below /
+  // above are counted in the first / last bin
+  int histogram_bins = 256;
+  // log2 spaced bins (the usual choice for HDR), otherwise linear
+  bool log_bins = true;
+  float histogram_min = 1.0f / 65536.0f;
+  float histogram_max = 65536.0f;
+};
+
+struct ImageStats {
+  size_t pixel_count{};
+  // pixels with at least one NaN channel, and pixels with at least one
+  // infinite (but no NaN) channel. These are left out of everything below
+  size_t nan_count{};
+  size_t inf_count{};
+
+  // per channel over the finite pixels
+  Color4f min = Color4f::Zero();
+  Color4f max = Color4f::Zero();
+  Color4f mean = Color4f::Zero();
+
+  // Luminance() of the finite pixels
+  float min_luminance{};
+  float max_luminance{};
+  float mean_luminance{};
+  // exp(mean(log(LOG_AVERAGE_DELTA + luminance))), the key used by auto
+  // exposure (Reinhard et al. 2002)
+  float log_average_luminance{};
+
+  std::vector<uint64_t> histogram;
+  bool log_bins{};
+  float histogram_min{};
+  float histogram_max{};
+
+  static constexpr float LOG_AVERAGE_DELTA = 1e-4f;
+
+  size_t FinitePixelCount() const {
+    return pixel_count - nan_count - inf_count;
+  }
+  // lower edge of bin `i`, i in [0, histogram.size()]
+  float BinEdge(int i) const;
+  // luminance below which a fraction `p` in [0, 1] of the finite pixels lies,
+  // interpolated inside the histogram bin (log2 interpolation for log bins),
+  // so the resolution is that of the histogram
+  float LuminancePercentile(float p) const;
+};
+
+// everything in ImageStats in a single parallel pass over the pixels. Fixed
+// blocks of rows accumulate their own partial sums and histogram, which are
+// merged in row order, so the result does not depend on the thread count.
+// Half images are widened to float a row at a time
+void ComputeImageStats(const ImageData4f &image, ImageStats *stats,
+                       const ImageStatsSettings &settings = {});
+void ComputeImageStats(const ImageData4h &image, ImageStats *stats,
+                       const ImageStatsSettings &settings = {});
+} // namespace lumos
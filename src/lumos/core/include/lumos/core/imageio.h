@@ -1,23 +1,172 @@
 #pragma once
 
 #include "lumos/core/common.h"
+#include "lumos/core/image_buffer.h"
+#include "lumos/core/pixel_format.h"
 #include <ImathBox.h>
 #include <filesystem>
+#include <string>
+#include <vector>
 
 namespace lumos {
+// number of threads used by the image readers and writers, both for OpenEXR
+// line buffer (de)compression and for the pixel format conversion, a value
+// <= 0 means one thread per hardware core, 1 disables threading. Setting it
+// resizes the process wide OpenEXR thread pool. Without a call the first exr
+// read or write sizes that pool only if it still has OpenEXR's default of 0
+// threads
+void SetImageIOThreadCount(int count);
+int GetImageIOThreadCount();
+
+// read png/exr files through a read only memory mapping (on by default), when
+// off OpenEXR and stb use their own buffered file reads
+void SetImageIOMemoryMapping(bool enable);
+bool GetImageIOMemoryMapping();
+
+// ask the os to start paging `input` in, e.g. for the next frames of an image
+// sequence, returns immediately
+void PrefetchImageFile(const std::filesystem::path &input);
+
 void ReadPng(const std::filesystem::path &input, ImageData4u8* output);
 
-template<typename T>
-void ReadExr(const std::filesystem::path &input, T* output);
+// the decoded stb buffer is adopted by `output`, no copy is made
+void ReadPngBuffer(const std::filesystem::path &input, ImageBuffer4u8 *output);
+
+// T is the ImageData of any pixel type with a PixelFormat (pixel_format.h),
+// the half pixels are converted with its kernels, Imf::Rgba and Color4f
+// images are decoded in place
+template <typename T, typename = EnableIfPixelImage<T>>
+void ReadExr(const std::filesystem::path &input, T *output);
+
+// query the data window size without decoding any pixel
+void ReadExrSize(const std::filesystem::path &input, int *height, int *width);
+
+// decode directly into caller owned storage, the view must match the data
+// window size reported by ReadExrSize
+void ReadExr(const std::filesystem::path &input, ImageDataView4h output);
+void ReadExr(const std::filesystem::path &input, ImageDataView4f output);
+
+// read rows [row_offset, row_offset + height) and cols [col_offset,
+// col_offset + width) only, in the pixel space of the file (the offsets of the
+// block SaveExr), the region has to lie inside the data window. Only the line
+// buffers, or for tiled files the tiles, overlapping the region are decoded
+template <typename T, typename = EnableIfPixelImage<T>>
+void ReadExrRegion(const std::filesystem::path &input, int row_offset,
+                   int col_offset, int height, int width, T *output);
+
+enum class PngFilter {
+  None,
+  Sub,
+  Up,
+  Average,
+  Paeth,
+  // per row, the filter with the minimum sum of absolute differences
+  Adaptive,
+};
+
+struct PngSettings {
+  // zlib level, 0 (stored) ~ 9 (best)
+  int compression_level = 6;
+  PngFilter filter = PngFilter::Adaptive;
+};
 
 // TODO: add support for ImageDataView series and Block ?
 void SavePng(const std::filesystem::path &output,
                     const ImageData4u8 &pic);
 
+// row bands are filtered and deflated in parallel (see SetImageIOThreadCount)
+// as independent deflate streams flushed to a byte boundary, concatenated
+// into a single zlib stream, the decoded pixels do not depend on the settings
+void SavePng(const std::filesystem::path &output, const ImageData4u8 &pic,
+             const PngSettings &settings);
+
+// same order as Imf::Compression
+enum class ExrCompression {
+  None,
+  Rle,
+  // zlib, 1 / 16 scanlines per block
+  Zips,
+  Zip,
+  // wavelet, good on noisy renders
+  Piz,
+  Pxr24,
+  B44,
+  B44a,
+  // lossy dct, 32 / 256 scanlines per block
+  Dwaa,
+  Dwab,
+};
+
+struct ExrSettings {
+  ExrCompression compression = ExrCompression::Zip;
+  // Dwaa / Dwab only, higher is smaller and lossier
+  float dwa_level = 45.0f;
+};
+
 void SaveExr(const std::filesystem::path &output,
                     const ImageData4f &pic);
 
 void SaveExr(const std::filesystem::path &output, int display_height,
                     int display_width, int row_offset, int col_offset,
                     const ImageData4f &block);
+
+void SaveExr(const std::filesystem::path &output, const ImageData4f &pic,
+             const ExrSettings &settings);
+
+void SaveExr(const std::filesystem::path &output, int display_height,
+             int display_width, int row_offset, int col_offset,
+             const ImageData4f &block, const ExrSettings &settings);
+
+// the ImageData of any pixel type with a PixelFormat (pixel_format.h),
+// converted to half with its kernels. Taken as ImageData<Pixel> rather than T
+// so that Eigen expressions such as blocks still go to the overloads above
+template <typename Pixel, typename = std::enable_if_t<IS_PIXEL_FORMAT<Pixel>>>
+void SaveExr(const std::filesystem::path &output, const ImageData<Pixel> &pic,
+             const ExrSettings &settings = {});
+
+template <typename Pixel, typename = std::enable_if_t<IS_PIXEL_FORMAT<Pixel>>>
+void SaveExr(const std::filesystem::path &output, int display_height,
+             int display_width, int row_offset, int col_offset,
+             const ImageData<Pixel> &block, const ExrSettings &settings = {});
+
+// same order as Imf::PixelType
+enum class ExrPixelType { Uint, Half, Float };
+
+// one part of a multi-part exr, e.g. {"albedo", {"R", "G", "B"}} or
+// {"depth", {"Z"}, ExrPixelType::Float}
+struct ExrLayer {
+  // part name, unique within the file
+  std::string name;
+  std::vector<std::string> channels;
+  ExrPixelType type = ExrPixelType::Half;
+  // height x width pixels of channels.size() interleaved samples, row major.
+  // float for Half / Float layers (converted on write), uint32_t for Uint
+  const void *data = nullptr;
+  ExrSettings settings;
+};
+
+// every layer becomes its own part, so a reader only decompresses the parts
+// it asks for, the line buffers of each part are compressed in parallel
+void SaveExrLayers(const std::filesystem::path &output, int height, int width,
+                   const std::vector<ExrLayer> &layers);
+
+struct ExrLayerInfo {
+  // empty for a single part file without a name
+  std::string name;
+  std::vector<std::string> channels;
+  int height = 0;
+  int width = 0;
+  ExrCompression compression = ExrCompression::None;
+};
+
+// parts of a (multi-part) exr file, no pixel is decoded
+void ReadExrLayerInfo(const std::filesystem::path &input,
+                      std::vector<ExrLayerInfo> *layers);
+
+// decode only `channels` of the part named `layer` into height x width pixels
+// of channels.size() interleaved floats, other parts are skipped entirely
+void ReadExrChannels(const std::filesystem::path &input,
+                     const std::string &layer,
+                     const std::vector<std::string> &channels, int *height,
+                     int *width, std::vector<float> *output);
 } // namespace lumos
\ No newline at end of file
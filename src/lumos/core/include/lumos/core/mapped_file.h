@@ -0,0 +1,55 @@
+#pragma once
+
+#include "lumos/core/common.h"
+
+#include <cstddef>
+#include <filesystem>
+
+namespace lumos {
+// read only memory mapping of a whole file, mmap on posix and
+// MapViewOfFile on windows. Repeated reads of the same file are served from
+// the page cache without an extra copy
+class MappedFile {
+public:
+  enum class AccessHint {
+    Normal,
+    Sequential,
+    Random,
+    // start reading the pages in the background (prefetching)
+    WillNeed,
+  };
+
+  MappedFile() = default;
+  explicit MappedFile(const std::filesystem::path &path);
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  MappedFile(MappedFile &&other) noexcept;
+  MappedFile &operator=(MappedFile &&other) noexcept;
+
+  ~MappedFile();
+
+  // madvise on posix, ignored where there is no equivalent
+  void Advise(AccessHint hint) const;
+
+  const char *Data() const { return m_data; }
+  size_t Size() const { return m_size; }
+  const std::filesystem::path &Path() const { return m_path; }
+
+private:
+  void close();
+
+  std::filesystem::path m_path;
+  const char *m_data{};
+  size_t m_size{};
+#ifdef _WIN32
+  void *m_file{};
+  void *m_mapping{};
+#endif
+};
+
+// ask the os to start reading `path` into the page cache and return, through
+// posix_fadvise where available so that nothing is mapped, otherwise through a
+// mapping advised with WillNeed
+void PrefetchFile(const std::filesystem::path &path);
+} // namespace lumos
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "lumos/core/common.h"
+#include "lumos/core/geometry.h"
+#include "lumos/core/vector.h"
+
+#include <cstdint>
+
+namespace lumos {
+// N_faces x 3 vertex indices, counter clockwise
+using IndexBuffer = Eigen::Matrix<uint32_t, Eigen::Dynamic, 3, Eigen::RowMajor>;
+// N_vertices x 3 positions, or N_vertices x 6 positions and normals, the
+// layout of the gl vertex buffers
+using VertexBuffer =
+    Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+
+// indexed triangle mesh, the buffers are validated once on construction
+class TriangleMesh {
+public:
+  TriangleMesh() = default;
+  TriangleMesh(VertexBuffer vertices, IndexBuffer indices);
+
+  int VertexCount() const { return static_cast<int>(m_vertices.rows()); }
+  int TriangleCount() const { return static_cast<int>(m_indices.rows()); }
+  bool HasNormals() const { return m_vertices.cols() == 6; }
+
+  const VertexBuffer &Vertices() const { return m_vertices; }
+  const IndexBuffer &Indices() const { return m_indices; }
+
+  Vector3f Position(uint32_t vertex) const {
+    const float *p = m_vertices.data() +
+                     static_cast<std::ptrdiff_t>(vertex) * m_vertices.cols();
+    return {p[0], p[1], p[2]};
+  }
+  void TrianglePositions(uint32_t triangle, Vector3f *p0, Vector3f *p1,
+                         Vector3f *p2) const {
+    *p0 = Position(m_indices(triangle, 0));
+    *p1 = Position(m_indices(triangle, 1));
+    *p2 = Position(m_indices(triangle, 2));
+  }
+
+  Bounds3f TriangleBounds(uint32_t triangle) const;
+  Bounds3f Bounds() const { return m_bounds; }
+  float SurfaceArea() const;
+
+  // unit normal of the triangle plane, following the winding order
+  Vector3f GeometricNormal(uint32_t triangle) const;
+  // interpolated vertex normal at the barycentric (u, v) (see RayHit), the
+  // geometric normal without vertex normals
+  Vector3f ShadingNormal(uint32_t triangle, float u, float v) const;
+
+private:
+  VertexBuffer m_vertices;
+  IndexBuffer m_indices;
+  Bounds3f m_bounds;
+};
+} // namespace lumos
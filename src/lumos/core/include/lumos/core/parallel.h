@@ -0,0 +1,103 @@
+#pragma once
+
+#include "lumos/core/common.h"
+
+#include <string>
+#include <string_view>
+
+#include <tbb/blocked_range.h>
+#include <tbb/blocked_range2d.h>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_sort.h>
+#include <tbb/task_arena.h>
+#include <tbb/task_group.h>
+
+// all parallel work runs on the oneTBB work-stealing scheduler: one worker per
+// hardware thread, tasks are split recursively and idle workers steal the
+// larger halves, so nested ParallelFor / TaskGroup calls compose without
+// oversubscription
+namespace lumos {
+// call func(begin, end) on disjoint sub ranges of [begin, end), each of them
+// at least `grain` long (except the last one)
+template <typename Func>
+void ParallelFor(int begin, int end, int grain, Func &&func) {
+  if (begin >= end) {
+    return;
+  }
+  tbb::parallel_for(
+      tbb::blocked_range<int>(begin, end, std::max(grain, 1)),
+      [&func](const tbb::blocked_range<int> &r) { func(r.begin(), r.end()); });
+}
+
+// call func(row_begin, row_end, col_begin, col_end) on disjoint blocks of
+// [row_begin, row_end) x [col_begin, col_end), blocks are split along the
+// longer side down to about grain_rows x grain_cols
+template <typename Func>
+void ParallelFor2D(int row_begin, int row_end, int col_begin, int col_end,
+                   int grain_rows, int grain_cols, Func &&func) {
+  if (row_begin >= row_end || col_begin >= col_end) {
+    return;
+  }
+  tbb::parallel_for(
+      tbb::blocked_range2d<int>(row_begin, row_end, std::max(grain_rows, 1),
+                                col_begin, col_end, std::max(grain_cols, 1)),
+      [&func](const tbb::blocked_range2d<int> &r) {
+        func(r.rows().begin(), r.rows().end(), r.cols().begin(),
+             r.cols().end());
+      });
+}
+
+// parallel (unstable) sort of the random access range [begin, end)
+template <typename Iterator, typename Compare>
+void ParallelSort(Iterator begin, Iterator end, const Compare &compare) {
+  tbb::parallel_sort(begin, end, compare);
+}
+
+template <typename Iterator> void ParallelSort(Iterator begin, Iterator end) {
+  tbb::parallel_sort(begin, end);
+}
+
+// fork / join of heterogeneous tasks. Run() may be called from inside running
+// tasks, Wait() helps executing them and rethrows the first exception thrown
+// by a task. The destructor waits for tasks that were not waited for
+class TaskGroup {
+public:
+  TaskGroup() = default;
+  ~TaskGroup();
+  TaskGroup(const TaskGroup &) = delete;
+  TaskGroup &operator=(const TaskGroup &) = delete;
+
+  template <typename Func> void Run(Func &&func) {
+    m_group.run(std::forward<Func>(func));
+  }
+  void Wait();
+
+private:
+  tbb::task_group m_group;
+};
+
+// number of threads that can run parallel work in the current arena, the
+// bound of ThreadIndex()
+inline int MaxThreadCount() { return tbb::this_task_arena::max_concurrency(); }
+
+// index of the calling thread in the arena it is working in, in
+// [0, MaxThreadCount()). It is unique within that arena only: threads of
+// another arena (e.g. the image io one) reuse the same indices, and a thread
+// that waits on nested parallel work may pick up another body of the same
+// ParallelFor meanwhile. A thread outside of any arena gets 0. For per thread
+// scratch or partial results use tbb::enumerable_thread_specific, which also
+// makes no promise about which thread did which part of the work
+inline int ThreadIndex() {
+  int index = tbb::this_task_arena::current_thread_index();
+  return index >= 0 ? index : 0;
+}
+
+// name the calling thread, shown by debuggers / top (first 15 bytes on linux)
+// and by the %N flag of the default logger pattern of SetupLogger
+void SetThreadName(std::string_view name);
+// the name given by SetThreadName, empty if the thread was never named
+const std::string &GetThreadName();
+// scheduler workers name themselves "lumos-worker-<n>" when they first join
+// the default arena from now on, called by SetupLogger
+void EnableWorkerThreadNames();
+} // namespace lumos
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "lumos/core/color.h"
+#include "lumos/core/common.h"
+#include "lumos/core/convert.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <type_traits>
+
+namespace lumos {
+// compile time description of a pixel type the image readers and writers
+// convert the half RGBA pixels of an exr file (Imf::Rgba) from and to:
+// FromRgba(src, dst, count) / ToRgba(src, dst, count) convert `count` pixels
+// in bulk, `src` and `dst` do not overlap. The primary template marks a type
+// as unsupported, the templated readers and writers such as ReadExr and
+// SaveExr do not accept images of it
+template <typename Pixel> struct PixelFormat {
+  static constexpr bool SUPPORTED = false;
+};
+
+template <typename Pixel>
+constexpr bool IS_PIXEL_FORMAT = PixelFormat<Pixel>::SUPPORTED;
+
+// enables a template for ImageData of a supported pixel type only
+template <typename T>
+using EnableIfPixelImage =
+    std::enable_if_t<IS_PIXEL_FORMAT<typename T::Scalar>>;
+
+template <> struct PixelFormat<Imf::Rgba> {
+  static constexpr bool SUPPORTED = true;
+  static void FromRgba(const Imf::Rgba *src, Imf::Rgba *dst, size_t count) {
+    std::copy_n(src, count, dst);
+  }
+  static void ToRgba(const Imf::Rgba *src, Imf::Rgba *dst, size_t count) {
+    std::copy_n(src, count, dst);
+  }
+};
+
+// same layout as Imf::Rgba
+template <> struct PixelFormat<Color4h> {
+  static constexpr bool SUPPORTED = true;
+  static void FromRgba(const Imf::Rgba *src, Color4h *dst, size_t count) {
+    std::copy_n(src, count, reinterpret_cast<Imf::Rgba *>(dst));
+  }
+  static void ToRgba(const Color4h *src, Imf::Rgba *dst, size_t count) {
+    std::copy_n(reinterpret_cast<const Imf::Rgba *>(src), count, dst);
+  }
+};
+
+template <> struct PixelFormat<Color4f> {
+  static constexpr bool SUPPORTED = true;
+  static void FromRgba(const Imf::Rgba *src, Color4f *dst, size_t count) {
+    HalfToFloat(src, dst, count);
+  }
+  static void ToRgba(const Color4f *src, Imf::Rgba *dst, size_t count) {
+    FloatToHalf(src, dst, count);
+  }
+};
+
+// alpha is dropped on read and 1 on write
+template <> struct PixelFormat<Color3f> {
+  static constexpr bool SUPPORTED = true;
+  static void FromRgba(const Imf::Rgba *src, Color3f *dst, size_t count) {
+    HalfToFloat(src, dst, count);
+  }
+  static void ToRgba(const Color3f *src, Imf::Rgba *dst, size_t count) {
+    FloatToHalf(src, dst, count);
+  }
+};
+
+// luminance on read, gray with alpha 1 on write
+template <> struct PixelFormat<float> {
+  static constexpr bool SUPPORTED = true;
+  static void FromRgba(const Imf::Rgba *src, float *dst, size_t count) {
+    HalfToLuminance(src, dst, count);
+  }
+  static void ToRgba(const float *src, Imf::Rgba *dst, size_t count) {
+    LuminanceToHalf(src, dst, count);
+  }
+};
+
+// display ready 8-bit, the color channels are sRGB encoded, alpha is linear
+template <> struct PixelFormat<Color4u8> {
+  static constexpr bool SUPPORTED = true;
+  static void FromRgba(const Imf::Rgba *src, Color4u8 *dst, size_t count) {
+    HalfToSrgb8(src, dst, count);
+  }
+  static void ToRgba(const Color4u8 *src, Imf::Rgba *dst, size_t count) {
+    Srgb8ToHalf(src, dst, count);
+  }
+};
+
+// every pixel type above, X(Pixel) is expanded once per type, e.g. to
+// explicitly instantiate the templated readers and writers
+#define LUMOS_FOR_EACH_PIXEL_FORMAT(X)                                         \
+  X(Imf::Rgba)                                                                 \
+  X(Color4h)                                                                   \
+  X(Color4f)                                                                   \
+  X(Color3f)                                                                   \
+  X(float)                                                                     \
+  X(Color4u8)
+} // namespace lumos
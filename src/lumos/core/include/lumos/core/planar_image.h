@@ -0,0 +1,115 @@
+#pragma once
+
+#include "lumos/core/buffer_pool.h"
+#include "lumos/core/color.h"
+#include "lumos/core/common.h"
+
+#include <cstring>
+#include <utility>
+
+namespace lumos {
+// structure of arrays image: one plane per channel, every row of every plane
+// starts on a ROW_ALIGNMENT boundary and is padded to a whole number of
+// ROW_ALIGNMENT bytes, so kernels can run full vector widths over all-R /
+// all-G / all-B rows. The padding is left uninitialized. Storage comes from
+// BufferPool::Global().
+template <typename Scalar> class PlanarImage {
+public:
+  // bytes, a cache line and one AVX-512 register
+  static constexpr size_t ROW_ALIGNMENT = BufferPool::ALIGNMENT;
+  using PlaneType =
+      Eigen::Array<Scalar, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+  using PlaneMap = Eigen::Map<PlaneType, Eigen::Unaligned, Eigen::OuterStride<>>;
+  using ConstPlaneMap =
+      Eigen::Map<const PlaneType, Eigen::Unaligned, Eigen::OuterStride<>>;
+
+  PlanarImage() = default;
+  PlanarImage(int channels, int rows, int cols) {
+    Resize(channels, rows, cols);
+  }
+
+  PlanarImage(const PlanarImage &other) { *this = other; }
+  PlanarImage &operator=(const PlanarImage &other) {
+    if (this != &other) {
+      Resize(other.m_channels, other.m_rows, other.m_cols);
+      if (Size() > 0) {
+        std::memcpy(m_data.Data(), other.m_data.Data(),
+                    Size() * sizeof(Scalar));
+      }
+    }
+    return *this;
+  }
+  PlanarImage(PlanarImage &&other) noexcept { *this = std::move(other); }
+  PlanarImage &operator=(PlanarImage &&other) noexcept {
+    m_data = std::move(other.m_data);
+    m_channels = std::exchange(other.m_channels, 0);
+    m_rows = std::exchange(other.m_rows, 0);
+    m_cols = std::exchange(other.m_cols, 0);
+    m_stride = std::exchange(other.m_stride, 0);
+    return *this;
+  }
+
+  // storage is only reallocated when the shape changes, pixels are not kept
+  void Resize(int channels, int rows, int cols) {
+    if (channels == m_channels && rows == m_rows && cols == m_cols) {
+      return;
+    }
+    m_channels = channels;
+    m_rows = rows;
+    m_cols = cols;
+    size_t row_bytes = static_cast<size_t>(cols) * sizeof(Scalar);
+    row_bytes = (row_bytes + ROW_ALIGNMENT - 1) / ROW_ALIGNMENT * ROW_ALIGNMENT;
+    m_stride = static_cast<int>(row_bytes / sizeof(Scalar));
+    // the old block goes back to the pool before the new one is requested
+    m_data = {};
+    m_data = PooledBuffer<Scalar>(Size());
+  }
+
+  int Channels() const { return m_channels; }
+  int Rows() const { return m_rows; }
+  int Cols() const { return m_cols; }
+  // distance between two rows in elements, >= Cols()
+  int Stride() const { return m_stride; }
+  // elements in all planes including the padding
+  size_t Size() const {
+    return static_cast<size_t>(m_channels) * m_rows * m_stride;
+  }
+
+  Scalar *Row(int channel, int row) {
+    return m_data.Data() +
+           (static_cast<size_t>(channel) * m_rows + row) * m_stride;
+  }
+  const Scalar *Row(int channel, int row) const {
+    return m_data.Data() +
+           (static_cast<size_t>(channel) * m_rows + row) * m_stride;
+  }
+
+  PlaneMap Plane(int channel) {
+    return PlaneMap(Row(channel, 0), m_rows, m_cols,
+                    Eigen::OuterStride<>(m_stride));
+  }
+  ConstPlaneMap Plane(int channel) const {
+    return ConstPlaneMap(Row(channel, 0), m_rows, m_cols,
+                         Eigen::OuterStride<>(m_stride));
+  }
+
+private:
+  PooledBuffer<Scalar> m_data;
+  int m_channels{};
+  int m_rows{};
+  int m_cols{};
+  int m_stride{};
+};
+
+using PlanarImagef = PlanarImage<float>;
+using PlanarImageu8 = PlanarImage<uint8_t>;
+
+// split into `channels` planes (3 drops alpha, 4 keeps it), rows are
+// converted in parallel with SSE transposes where available
+void ToPlanar(const ImageData4f &src, PlanarImagef *dst, int channels = 4);
+void ToPlanar(const ImageData4u8 &src, PlanarImageu8 *dst, int channels = 4);
+
+// interleave 3 or 4 planes, alpha is set to opaque for 3 planes
+void FromPlanar(const PlanarImagef &src, ImageData4f *dst);
+void FromPlanar(const PlanarImageu8 &src, ImageData4u8 *dst);
+} // namespace lumos
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "lumos/core/color.h"
+#include "lumos/core/common.h"
+
+#include <vector>
+
+namespace lumos {
+enum class PyramidFilter {
+  // exact pixel coverage: a 2x2 average for even sizes, 3 taps per axis
+  // (weighted by how much of each source pixel is covered) for odd sizes
+  Box,
+  // kaiser windowed sinc (width 3, alpha 4), sharper than box, the slight
+  // ringing below zero at hard edges is clamped
+  Kaiser,
+};
+
+struct PyramidSettings {
+  PyramidFilter filter = PyramidFilter::Box;
+  // number of levels below the input, <= 0 goes all the way down to 1x1
+  int max_levels = 0;
+  // ImageData4u8 only: decode sRGB and filter in linear light (alpha is always
+  // linear), otherwise the bytes are filtered as linear [0, 1] values
+  bool srgb = true;
+};
+
+// every level is max(1, size / 2) of the previous one in both dimensions, the
+// OpenGL / OpenEXR round down convention, (*levels)[i] is mip level i + 1.
+// Levels are filtered from the previous float level, rows in parallel
+void BuildPyramid(const ImageData4f &image, std::vector<ImageData4f> *levels,
+                  const PyramidSettings &settings = {});
+void BuildPyramid(const ImageData4u8 &image, std::vector<ImageData4u8> *levels,
+                  const PyramidSettings &settings = {});
+
+// a single level, `dst` is max(1, size / 2) of `src`
+void Downsample(const ImageData4f &src, ImageData4f *dst,
+                PyramidFilter filter = PyramidFilter::Box);
+} // namespace lumos
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "lumos/core/color.h"
+#include "lumos/core/common.h"
+
+namespace lumos {
+enum class ResampleFilter {
+  // exact pixel coverage when shrinking, nearest neighbour when enlarging
+  Box,
+  // tent, radius 1
+  Bilinear,
+  // Mitchell-Netravali cubic (B = C = 1/3), radius 2
+  Mitchell,
+  // windowed sinc, radius 3
+  Lanczos3,
+  // kaiser windowed sinc (alpha 4), radius 3
+  Kaiser,
+};
+
+struct ResampleSettings {
+  ResampleFilter filter = ResampleFilter::Lanczos3;
+  // ImageData4u8 only: decode sRGB and filter in linear light (alpha is always
+  // linear), otherwise the bytes are filtered as linear [0, 1] values
+  bool srgb = true;
+};
+
+// resize `src` to height x width. The filter is stretched by the scale when
+// shrinking so it always covers at least one destination pixel, edges are
+// clamped. Filters with negative lobes (Mitchell, Lanczos3, Kaiser) can ring
+// below zero at hard edges, the result is clamped to >= 0.
+// The two passes run in the cheaper order, rows in parallel, every pixel is
+// accumulated as a Color4f packet. Weight tables are cached per (source size,
+// destination size, filter), so repeated resizes of the same shape reuse them
+void Resample(const ImageData4f &src, int height, int width, ImageData4f *dst,
+              const ResampleSettings &settings = {});
+void Resample(const ImageData4u8 &src, int height, int width,
+              ImageData4u8 *dst, const ResampleSettings &settings = {});
+} // namespace lumos
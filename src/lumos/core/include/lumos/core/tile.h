@@ -0,0 +1,98 @@
+#pragma once
+
+#include "lumos/core/common.h"
+#include "lumos/core/parallel.h"
+
+namespace lumos {
+// what happens to the rows / columns left over when the image size is not a
+// multiple of the tile size
+enum class TileEdge {
+  // the last tile of a row / column is smaller
+  Partial,
+  // the remainder is added to the last tile, no tile is smaller than the tile
+  // size (unless the image is), edge tiles are up to twice as large
+  Merge,
+  // only whole tiles, the remainder is not visited
+  Skip,
+};
+
+// bytes of pixels per tile a tile size is derived from, a good part of a
+// typical 256 KiB - 1 MiB L2 and well within a shared L3 slice
+constexpr size_t TILE_CACHE_BYTES = 64 * 1024;
+
+// the largest power of two side for square tiles of `pixel_bytes` pixels
+// fitting `cache_bytes`, at least 8
+int TileSizeForCache(size_t pixel_bytes, size_t cache_bytes = TILE_CACHE_BYTES);
+
+struct TileSettings {
+  int tile_rows = 64;
+  int tile_cols = 64;
+  TileEdge edge = TileEdge::Partial;
+};
+
+// square tiles fitting TILE_CACHE_BYTES for `Pixel`
+template <typename Pixel>
+TileSettings CacheTileSettings(TileEdge edge = TileEdge::Partial) {
+  int size = TileSizeForCache(sizeof(Pixel));
+  return {size, size, edge};
+}
+
+struct Tile {
+  // position in the tile grid, index = tile_row * TileCols() + tile_col
+  int tile_row{};
+  int tile_col{};
+  int index{};
+  // pixel region
+  int row{};
+  int col{};
+  int rows{};
+  int cols{};
+};
+
+// partition of a rows x cols image into tiles
+class TileGrid {
+public:
+  TileGrid(int rows, int cols, const TileSettings &settings = {});
+
+  int TileRows() const { return m_tile_rows; }
+  int TileCols() const { return m_tile_cols; }
+  int TileCount() const { return m_tile_rows * m_tile_cols; }
+  Tile GetTile(int tile_row, int tile_col) const;
+  Tile GetTile(int index) const {
+    return GetTile(index / m_tile_cols, index % m_tile_cols);
+  }
+
+private:
+  // start and length of tile `i` along an axis
+  void axis(int i, int tiles, int tile_size, int size, int *begin,
+            int *length) const;
+
+  int m_rows;
+  int m_cols;
+  TileSettings m_settings;
+  int m_tile_rows;
+  int m_tile_cols;
+};
+
+// call func(tile, block) for every tile of `image` in parallel, `block` is
+// image.block(tile.row, tile.col, tile.rows, tile.cols), a view into the image
+// (no copy, read only for a const image). Neighbouring tiles are handed to the
+// same task where possible. Works for ImageData, ImageDataView and other dense
+// expressions with direct access
+template <typename Image, typename Func>
+void ParallelForTiles(Image &&image, const TileSettings &settings,
+                      Func &&func) {
+  TileGrid grid(static_cast<int>(image.rows()), static_cast<int>(image.cols()),
+                settings);
+  ParallelFor2D(0, grid.TileRows(), 0, grid.TileCols(), 1, 1,
+                [&](int row_begin, int row_end, int col_begin, int col_end) {
+                  for (int r = row_begin; r < row_end; ++r) {
+                    for (int c = col_begin; c < col_end; ++c) {
+                      Tile tile = grid.GetTile(r, c);
+                      func(tile, image.block(tile.row, tile.col, tile.rows,
+                                             tile.cols));
+                    }
+                  }
+                });
+}
+} // namespace lumos
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "lumos/core/color.h"
+#include "lumos/core/common.h"
+#include "lumos/core/imageio.h"
+
+#include <atomic>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace Imf {
+class TiledRgbaOutputFile;
+}
+
+namespace lumos {
+enum class ExrLevelMode {
+  // full resolution only
+  Single,
+  // level l is (width >> l) x (height >> l), rounded down
+  Mipmap,
+  // level (level_x, level_y) is (width >> level_x) x (height >> level_y)
+  Ripmap,
+};
+
+// a tiled exr file that is opened once and filled tile by tile, e.g. by a
+// progressive renderer. Tiles are stored in the order they are written
+// (RANDOM_Y line order), so every WriteTile compresses and appends exactly one
+// tile no matter the order, nothing is buffered. The tile offset table is
+// written when the writer is destroyed, tiles never written by then are filled
+// with transparent black (with a warning) so that the file stays readable.
+// WriteTile may be called from several threads.
+class TiledExrWriter {
+public:
+  TiledExrWriter(const std::filesystem::path &output, int display_height,
+                 int display_width, int tile_size = 64,
+                 ExrLevelMode level_mode = ExrLevelMode::Single,
+                 const ExrSettings &settings = {});
+  ~TiledExrWriter();
+
+  TiledExrWriter(const TiledExrWriter &) = delete;
+  TiledExrWriter &operator=(const TiledExrWriter &) = delete;
+
+  int TileSize() const { return m_tile_size; }
+  ExrLevelMode LevelMode() const { return m_level_mode; }
+
+  // number of levels in x / y, for mipmaps both are the same, for a single
+  // level file both are 1
+  int LevelsX() const;
+  int LevelsY() const;
+  int LevelWidth(int level_x) const;
+  int LevelHeight(int level_y) const;
+  int TileCols(int level_x = 0) const;
+  int TileRows(int level_y = 0) const;
+
+  // pixel rectangle covered by a tile of the given level, tiles on the right
+  // and bottom edge may be smaller than TileSize()
+  void TileRegion(int tile_row, int tile_col, int *row_offset, int *col_offset,
+                  int *height, int *width, int level_x = 0,
+                  int level_y = 0) const;
+
+  // `tile` has to be exactly the size reported by TileRegion, for mipmaps
+  // level_x and level_y must be equal. Writing a tile twice is an error
+  void WriteTile(int tile_row, int tile_col, const ImageData4f &tile,
+                 int level_x = 0, int level_y = 0);
+
+  // tiles over all levels, and how many of them have been written so far
+  size_t TileCount() const { return m_written.size(); }
+  size_t TilesWritten() const { return m_tiles_written; }
+
+private:
+  void checkTile(int tile_row, int tile_col, int level_x, int level_y) const;
+  // position of a valid tile in m_written
+  size_t tileIndex(int tile_row, int tile_col, int level_x, int level_y) const;
+
+  std::filesystem::path m_output;
+  std::unique_ptr<Imf::TiledRgbaOutputFile> m_file;
+  ExrLevelMode m_level_mode{};
+  int m_tile_size{};
+  // first tile of each level in m_written, indexed by level_y * LevelsX() +
+  // level_x, unused for the levels a mipmap does not have
+  std::vector<size_t> m_level_offsets;
+  // guarded by m_mutex
+  std::vector<bool> m_written;
+  std::mutex m_mutex;
+  std::atomic<size_t> m_tiles_written{0};
+};
+} // namespace lumos
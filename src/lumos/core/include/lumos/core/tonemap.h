@@ -0,0 +1,27 @@
+#pragma once
+
+#include "lumos/core/common.h"
+
+namespace lumos {
+enum class TonemapOperator {
+  Clamp,    // plain clamp to [0, 1]
+  Reinhard, // x / (1 + x)
+  AcesFit,  // Narkowicz 2015 fit of the ACES filmic curve
+};
+
+struct TonemapSettings {
+  // in stops, the linear input is scaled by 2^exposure
+  float exposure = 0.0f;
+  TonemapOperator op = TonemapOperator::Clamp;
+  // 4x4 ordered (Bayer) dithering before quantization, removes banding in
+  // smooth gradients
+  bool dither = false;
+};
+
+// exposure + tonemap + sRGB encode + 8-bit quantization in a single pass, rows
+// are processed in parallel through a small per task buffer, no intermediate
+// float image is created. Alpha is only clamped and quantized. With the
+// default settings the result matches ToUint8(ToSrgb(c)) (see LinearToSrgb8)
+void Tonemap(const ImageData4f &src, ImageData4u8 *dst,
+             const TonemapSettings &settings = {});
+} // namespace lumos
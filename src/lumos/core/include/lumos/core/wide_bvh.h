@@ -0,0 +1,91 @@
+#pragma once
+
+#include "lumos/core/bvh.h"
+#include "lumos/core/common.h"
+#include "lumos/core/geometry.h"
+#include "lumos/core/mesh.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace lumos {
+// child boxes in SoA layout, [axis][child], so that one instruction handles
+// one slab of all children. Unused slots hold an empty box, which no ray hits
+template <int Width> struct alignas(4 * Width) WideBvhNode {
+  float lower[3][Width];
+  float upper[3][Width];
+  // without WideBvh::LEAF_BIT the index of a child node, with it a leaf: the
+  // position of its first triangle in packet order in the low bits and the
+  // triangle count - 1 above them (see WideBvh::LEAF_COUNT_SHIFT)
+  uint32_t children[Width];
+};
+
+// four triangles in SoA layout, [axis][lane], vertex 0 and the edges to
+// vertices 1 and 2 so that the leaf test does not touch the mesh
+struct TrianglePacket {
+  float p0[3][4] = {};
+  float e1[3][4] = {};
+  float e2[3][4] = {};
+  // INVALID_INDEX in the unused lanes of the last packet
+  uint32_t triangles[4] = {INVALID_INDEX, INVALID_INDEX, INVALID_INDEX,
+                           INVALID_INDEX};
+};
+
+// bounding volume hierarchy with `Width` (4 or 8) children per node,
+// collapsed from a binary Bvh by repeatedly opening the interior child with
+// the largest surface area. A query tests all child boxes of a node at once
+// (SSE for 4, AVX for 8 when the cpu has it) and visits the hit children
+// nearest first. Leaves are no nodes of their own but a child reference to a
+// range of the triangles, which are packed four to a TrianglePacket in leaf
+// order without padding between leaves. Like Bvh the mesh is referenced and
+// has to outlive the WideBvh.
+// The leaves are taken over as they are and hold at most MAX_LEAF_TRIANGLES
+// triangles: WideBvh(const Bvh &) throws on a larger leaf, which a Bvh built
+// with BvhSettings::max_leaf_size above that limit can have
+template <int Width> class WideBvh {
+  static_assert(Width == 4 || Width == 8, "4 or 8 children per node");
+
+public:
+  using Node = WideBvhNode<Width>;
+
+  static constexpr uint32_t LEAF_BIT = 1u << 31;
+  static constexpr int LEAF_COUNT_SHIFT = 27;
+  static constexpr uint32_t MAX_LEAF_TRIANGLES = 16;
+  static constexpr uint32_t MAX_TRIANGLES = 1u << LEAF_COUNT_SHIFT;
+
+  explicit WideBvh(const Bvh &bvh);
+  // builds a binary Bvh first, settings.max_leaf_size is limited the same way
+  explicit WideBvh(const TriangleMesh &mesh, const BvhSettings &settings = {});
+
+  // closest hit in (ray.t_min, ray.t_max), `hit` is left untouched on a miss
+  bool Intersect(const Ray &ray, RayHit *hit) const;
+  // any hit in (ray.t_min, ray.t_max), returns at the first one found
+  bool Occluded(const Ray &ray) const;
+  // the same queries one child and one triangle at a time, what Intersect /
+  // Occluded run without SSE (without AVX for Bvh8), the reference of the
+  // vector paths
+  bool IntersectScalar(const Ray &ray, RayHit *hit) const;
+  bool OccludedScalar(const Ray &ray) const;
+
+  const TriangleMesh &Mesh() const { return *m_mesh; }
+  // node 0 is the root
+  const std::vector<Node> &Nodes() const { return m_nodes; }
+  const std::vector<TrianglePacket> &Packets() const { return m_packets; }
+  Bounds3f Bounds() const { return m_bounds; }
+  int Depth() const { return m_depth; }
+  // bytes held by the nodes and the packets
+  size_t MemoryBytes() const;
+
+private:
+  void collapse(const Bvh &bvh);
+
+  const TriangleMesh *m_mesh;
+  std::vector<Node> m_nodes;
+  std::vector<TrianglePacket> m_packets;
+  Bounds3f m_bounds;
+  int m_depth = 0;
+};
+
+using Bvh4 = WideBvh<4>;
+using Bvh8 = WideBvh<8>;
+} // namespace lumos
@@ -0,0 +1,128 @@
+#include "lumos/core/async_writer.h"
+#include "lumos/core/imageio.h"
+#include "lumos/core/parallel.h"
+
+#include <spdlog/fmt/ostr.h>
+
+#include <exception>
+
+namespace lumos {
+AsyncImageWriter::AsyncImageWriter(int workers, size_t max_pending)
+    : m_max_pending(std::max<size_t>(max_pending, 1)) {
+  workers = std::max(workers, 1);
+  DEBUG("start async image writer, workers: {}, max pending: {}", workers,
+        m_max_pending);
+  m_workers.reserve(workers);
+  try {
+    for (int i = 0; i < workers; ++i) {
+      m_workers.emplace_back([this, i]() {
+        SetThreadName(fmt::format("lumos-writer-{}", i));
+        workerLoop();
+      });
+    }
+  } catch (...) {
+    // the destructor does not run for a throwing constructor, the workers
+    // started so far have to be joined here
+    stop();
+    throw;
+  }
+}
+
+AsyncImageWriter::~AsyncImageWriter() { stop(); }
+
+std::future<void> AsyncImageWriter::SavePng(const std::filesystem::path &output,
+                                            ImageData4u8 pic) {
+  return Submit(
+      [output, pic = std::move(pic)]() { lumos::SavePng(output, pic); });
+}
+
+std::future<void> AsyncImageWriter::SaveExr(const std::filesystem::path &output,
+                                            ImageData4f pic,
+                                            const ExrSettings &settings) {
+  return Submit([output, pic = std::move(pic), settings]() {
+    lumos::SaveExr(output, pic, settings);
+  });
+}
+
+std::future<void> AsyncImageWriter::SaveExr(const std::filesystem::path &output,
+                                            int display_height,
+                                            int display_width, int row_offset,
+                                            int col_offset, ImageData4f block,
+                                            const ExrSettings &settings) {
+  return Submit([=, block = std::move(block)]() {
+    lumos::SaveExr(output, display_height, display_width, row_offset,
+                   col_offset, block, settings);
+  });
+}
+
+void AsyncImageWriter::Wait() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_idle.wait(lock, [this]() { return m_pending == 0; });
+}
+
+size_t AsyncImageWriter::Pending() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_pending;
+}
+
+std::future<void> AsyncImageWriter::Submit(std::function<void()> write) {
+  Job job{std::move(write), {}};
+  auto future = job.done.get_future();
+  std::unique_lock<std::mutex> lock(m_mutex);
+  // backpressure, wait for a free slot
+  m_not_full.wait(lock, [this]() { return m_pending < m_max_pending; });
+  ++m_pending;
+  m_queue.emplace_back(std::move(job));
+  lock.unlock();
+  m_not_empty.notify_one();
+  return future;
+}
+
+void AsyncImageWriter::stop() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  m_not_empty.notify_all();
+  for (auto &worker : m_workers) {
+    worker.join();
+  }
+}
+
+void AsyncImageWriter::workerLoop() {
+  while (true) {
+    Job job;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_not_empty.wait(lock, [this]() { return m_stop || !m_queue.empty(); });
+      if (m_queue.empty()) {
+        return;
+      }
+      job = std::move(m_queue.front());
+      m_queue.pop_front();
+    }
+    // exceptions are stored in the future
+    std::exception_ptr error;
+    try {
+      job.write();
+    } catch (...) {
+      error = std::current_exception();
+    }
+    // release the image before the future is ready and the slot is freed
+    job.write = nullptr;
+    if (error) {
+      job.done.set_exception(error);
+    } else {
+      job.done.set_value();
+    }
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      --m_pending;
+      if (m_pending == 0) {
+        m_idle.notify_all();
+      }
+    }
+    m_not_full.notify_one();
+  }
+}
+} // namespace lumos
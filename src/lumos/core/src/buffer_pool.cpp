@@ -0,0 +1,141 @@
+#include "lumos/core/buffer_pool.h"
+
+#include <new>
+
+namespace lumos {
+namespace {
+constexpr size_t SMALL_CLASS_LIMIT = 4096;
+// size classes per power of two above SMALL_CLASS_LIMIT
+constexpr size_t CLASSES_PER_OCTAVE = 4;
+
+void *alignedNew(size_t bytes) {
+  return ::operator new(bytes, std::align_val_t(BufferPool::ALIGNMENT));
+}
+
+void alignedDelete(void *p) {
+  ::operator delete(p, std::align_val_t(BufferPool::ALIGNMENT));
+}
+} // namespace
+
+BufferPool::BufferPool(size_t max_cached_bytes)
+    : m_max_cached_bytes(max_cached_bytes) {}
+
+BufferPool::~BufferPool() {
+  Trim();
+  if (m_stats.bytes_in_use > 0) {
+    WARN("buffer pool destroyed with {} bytes still in use",
+         m_stats.bytes_in_use);
+  }
+}
+
+BufferPool &BufferPool::Global() {
+  // never destroyed, buffers may be returned from other static destructors
+  static BufferPool *pool = new BufferPool();
+  return *pool;
+}
+
+size_t BufferPool::SizeClass(size_t bytes) {
+  if (bytes <= SMALL_CLASS_LIMIT) {
+    return std::max<size_t>((bytes + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT,
+                            ALIGNMENT);
+  }
+  size_t octave = SMALL_CLASS_LIMIT;
+  while (octave <= bytes / 2) {
+    octave *= 2;
+  }
+  size_t step = octave / CLASSES_PER_OCTAVE;
+  return (bytes + step - 1) / step * step;
+}
+
+void *BufferPool::Allocate(size_t bytes) {
+  if (bytes == 0) {
+    return nullptr;
+  }
+  size_t size = SizeClass(bytes);
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ++m_stats.requests;
+    auto it = m_free.find(size);
+    if (it != m_free.end() && !it->second.empty()) {
+      void *p = it->second.back();
+      it->second.pop_back();
+      ++m_stats.hits;
+      m_stats.bytes_cached -= size;
+      m_stats.bytes_in_use += size;
+      return p;
+    }
+  }
+  // the system allocation runs outside of the lock
+  void *p = alignedNew(size);
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_stats.bytes_in_use += size;
+  m_stats.peak_footprint =
+      std::max(m_stats.peak_footprint,
+               m_stats.bytes_in_use + m_stats.bytes_cached);
+  return p;
+}
+
+void BufferPool::Deallocate(void *p, size_t bytes) {
+  if (!p) {
+    return;
+  }
+  size_t size = SizeClass(bytes);
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stats.bytes_in_use -= size;
+    if (m_stats.bytes_cached + size <= m_max_cached_bytes) {
+      m_free[size].push_back(p);
+      m_stats.bytes_cached += size;
+      return;
+    }
+  }
+  alignedDelete(p);
+}
+
+void BufferPool::Trim() { trimTo(0); }
+
+void BufferPool::SetMaxCachedBytes(size_t bytes) {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_max_cached_bytes = bytes;
+  }
+  trimTo(bytes);
+}
+
+size_t BufferPool::GetMaxCachedBytes() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_max_cached_bytes;
+}
+
+BufferPoolStats BufferPool::Stats() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_stats;
+}
+
+void BufferPool::ResetStats() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_stats.requests = 0;
+  m_stats.hits = 0;
+  m_stats.peak_footprint = m_stats.bytes_in_use + m_stats.bytes_cached;
+}
+
+// largest classes are released first, they are the least likely to be reused
+void BufferPool::trimTo(size_t bytes) {
+  std::vector<void *> released;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto it = m_free.rbegin();
+         it != m_free.rend() && m_stats.bytes_cached > bytes; ++it) {
+      auto &blocks = it->second;
+      while (!blocks.empty() && m_stats.bytes_cached > bytes) {
+        released.push_back(blocks.back());
+        blocks.pop_back();
+        m_stats.bytes_cached -= it->first;
+      }
+    }
+  }
+  for (void *p : released) {
+    alignedDelete(p);
+  }
+}
+} // namespace lumos
@@ -0,0 +1,589 @@
+#include "lumos/core/bvh.h"
+#include "lumos/core/exception.h"
+#include "lumos/core/parallel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <memory>
+
+namespace lumos {
+namespace {
+// below this depth splits are by SAH, deeper nodes are split at the centroid
+// median so that the depth stays bounded (by SAH_MAX_DEPTH + 32)
+constexpr int SAH_MAX_DEPTH = 64;
+static_assert(SAH_MAX_DEPTH + 32 < Bvh::MAX_DEPTH);
+static_assert(sizeof(BvhNode) == 32);
+
+// ranges up to this size are built serially by a single task
+constexpr uint32_t SUBTREE_TRIANGLES = 4096;
+// ranges at least this large are bounded and binned in parallel, in chunks of
+// BUILD_GRAIN triangles
+constexpr uint32_t PARALLEL_BINNING_TRIANGLES = 64 * 1024;
+constexpr int BUILD_GRAIN = 16 * 1024;
+// bits per axis of the morton codes
+constexpr int MORTON_BITS = 10;
+
+// what the build needs of a triangle
+struct PrimRef {
+  Bounds3f bounds;
+  Vector3f centroid;
+  uint32_t triangle;
+};
+
+struct Bin {
+  Bounds3f bounds;
+  uint32_t count = 0;
+};
+
+struct Split {
+  int axis = -1;
+  // triangles in bins [0, bin] go to the first child
+  int bin = 0;
+  float cost = std::numeric_limits<float>::infinity();
+
+  bool Valid() const { return axis >= 0; }
+};
+
+// maps a centroid coordinate to its bin along one axis
+struct Binning {
+  float offset = 0.0f;
+  float scale = 0.0f;
+  int bins = 0;
+
+  Binning(const Bounds3f &centroid_bounds, int axis, int bin_count)
+      : offset(centroid_bounds.min[axis]), bins(bin_count) {
+    float extent = centroid_bounds.max[axis] - centroid_bounds.min[axis];
+    // slightly below bins / extent so that the max lands in the last bin
+    scale = extent > 0.0f ? bin_count * (1.0f - 1e-5f) / extent : 0.0f;
+  }
+
+  int operator()(float x) const {
+    int bin = static_cast<int>((x - offset) * scale);
+    return std::min(std::max(bin, 0), bins - 1);
+  }
+};
+
+// calls func(begin, end, partial) over [0, count), for large counts in
+// parallel over fixed blocks of BUILD_GRAIN refs, each block reducing into its
+// own element of `partials`, so they do not depend on the threads
+template <typename Partial, typename Func>
+void reduceRefs(uint32_t count, std::vector<Partial> *partials,
+                const Partial &init, Func &&func) {
+  if (count < PARALLEL_BINNING_TRIANGLES) {
+    partials->assign(1, init);
+    func(0, count, &(*partials)[0]);
+    return;
+  }
+  constexpr uint32_t grain = BUILD_GRAIN;
+  int blocks = static_cast<int>((count + grain - 1) / grain);
+  partials->assign(blocks, init);
+  ParallelFor(0, blocks, 1, [&](int begin, int end) {
+    for (int b = begin; b < end; ++b) {
+      uint32_t first = static_cast<uint32_t>(b) * grain;
+      func(first, std::min(count, first + grain), &(*partials)[b]);
+    }
+  });
+}
+
+void computeBounds(const PrimRef *refs, uint32_t count, Bounds3f *bounds,
+                   Bounds3f *centroid_bounds) {
+  std::vector<std::pair<Bounds3f, Bounds3f>> partials;
+  reduceRefs(count, &partials, {},
+             [refs](uint32_t begin, uint32_t end,
+                    std::pair<Bounds3f, Bounds3f> *partial) {
+               for (uint32_t i = begin; i < end; ++i) {
+                 partial->first.Extend(refs[i].bounds);
+                 partial->second.Extend(refs[i].centroid);
+               }
+             });
+  *bounds = Bounds3f();
+  *centroid_bounds = Bounds3f();
+  for (const auto &partial : partials) {
+    bounds->Extend(partial.first);
+    centroid_bounds->Extend(partial.second);
+  }
+}
+
+// best SAH split of refs over all three axes, invalid if the centroids
+// coincide
+Split findSplit(const PrimRef *refs, uint32_t count, const Bounds3f &bounds,
+                const Bounds3f &centroid_bounds, const BvhSettings &settings) {
+  int bin_count = settings.bin_count;
+  const Binning binnings[3] = {Binning(centroid_bounds, 0, bin_count),
+                               Binning(centroid_bounds, 1, bin_count),
+                               Binning(centroid_bounds, 2, bin_count)};
+  // the bins of all three axes in one pass
+  std::vector<std::vector<Bin>> partials;
+  reduceRefs(count, &partials, std::vector<Bin>(3 * bin_count),
+             [&](uint32_t begin, uint32_t end, std::vector<Bin> *partial) {
+               for (uint32_t i = begin; i < end; ++i) {
+                 for (int axis = 0; axis < 3; ++axis) {
+                   int b = binnings[axis](refs[i].centroid[axis]);
+                   Bin &bin = (*partial)[axis * bin_count + b];
+                   bin.bounds.Extend(refs[i].bounds);
+                   ++bin.count;
+                 }
+               }
+             });
+  std::vector<Bin> &bins = partials[0];
+  for (size_t p = 1; p < partials.size(); ++p) {
+    for (int i = 0; i < 3 * bin_count; ++i) {
+      bins[i].bounds.Extend(partials[p][i].bounds);
+      bins[i].count += partials[p][i].count;
+    }
+  }
+
+  std::vector<float> right_area(bin_count);
+  std::vector<uint32_t> right_count(bin_count);
+  float area = std::max(bounds.SurfaceArea(),
+                        std::numeric_limits<float>::min());
+  Split best;
+  for (int axis = 0; axis < 3; ++axis) {
+    if (!(centroid_bounds.max[axis] > centroid_bounds.min[axis])) {
+      continue;
+    }
+    const Bin *axis_bins = bins.data() + axis * bin_count;
+    // sweep from the right for the second child, then from the left
+    Bounds3f right;
+    uint32_t n = 0;
+    for (int b = bin_count - 1; b > 0; --b) {
+      right.Extend(axis_bins[b].bounds);
+      n += axis_bins[b].count;
+      right_area[b] = right.SurfaceArea();
+      right_count[b] = n;
+    }
+    Bounds3f left;
+    n = 0;
+    for (int b = 0; b < bin_count - 1; ++b) {
+      left.Extend(axis_bins[b].bounds);
+      n += axis_bins[b].count;
+      if (n == 0 || right_count[b + 1] == 0) {
+        continue;
+      }
+      float cost = settings.traversal_cost +
+                   settings.intersection_cost *
+                       (left.SurfaceArea() * n +
+                        right_area[b + 1] * right_count[b + 1]) /
+                       area;
+      if (cost < best.cost) {
+        best.axis = axis;
+        best.bin = b;
+        best.cost = cost;
+      }
+    }
+  }
+  return best;
+}
+
+// how refs [begin, end) are divided between two children, mid == begin for a
+// leaf
+struct Division {
+  uint32_t mid;
+  int axis;
+};
+
+Division divide(PrimRef *refs, uint32_t begin, uint32_t end, int depth,
+                const Bounds3f &bounds, const Bounds3f &centroid_bounds,
+                const BvhSettings &settings) {
+  uint32_t count = end - begin;
+  bool fits_leaf = count <= static_cast<uint32_t>(settings.max_leaf_size);
+  Split split;
+  if (count > 1 && depth < SAH_MAX_DEPTH) {
+    split = findSplit(refs + begin, count, bounds, centroid_bounds, settings);
+  }
+  if (count == 1 ||
+      (fits_leaf && !(split.cost < count * settings.intersection_cost))) {
+    return {begin, 0};
+  }
+  if (split.Valid()) {
+    int axis = split.axis;
+    Binning binning(centroid_bounds, axis, settings.bin_count);
+    PrimRef *mid = std::partition(
+        refs + begin, refs + end, [&](const PrimRef &ref) {
+          return binning(ref.centroid[axis]) <= split.bin;
+        });
+    return {static_cast<uint32_t>(mid - refs), axis};
+  }
+  // coinciding centroids or too deep
+  int axis = centroid_bounds.MaxExtent();
+  uint32_t mid = begin + count / 2;
+  std::nth_element(refs + begin, refs + mid, refs + end,
+                   [axis](const PrimRef &a, const PrimRef &b) {
+                     return a.centroid[axis] < b.centroid[axis];
+                   });
+  return {mid, axis};
+}
+
+// builds the subtree over refs [begin, end) into `nodes`, its root goes to
+// the already allocated `node`, returns the depth of the subtree
+int buildSubtree(PrimRef *refs, uint32_t begin, uint32_t end, int depth,
+                 const BvhSettings &settings, uint32_t node,
+                 std::vector<BvhNode> *nodes) {
+  Bounds3f bounds;
+  Bounds3f centroid_bounds;
+  computeBounds(refs + begin, end - begin, &bounds, &centroid_bounds);
+  Division division =
+      divide(refs, begin, end, depth, bounds, centroid_bounds, settings);
+  if (division.mid == begin) {
+    (*nodes)[node] = {bounds, begin, static_cast<uint16_t>(end - begin), 0};
+    return 1;
+  }
+  uint32_t children = static_cast<uint32_t>(nodes->size());
+  nodes->resize(children + 2);
+  (*nodes)[node] = {bounds, children, 0,
+                    static_cast<uint16_t>(division.axis)};
+  int first = buildSubtree(refs, begin, division.mid, depth + 1, settings,
+                           children, nodes);
+  int second = buildSubtree(refs, division.mid, end, depth + 1, settings,
+                            children + 1, nodes);
+  return 1 + std::max(first, second);
+}
+
+// the 10 low bits of v spread to every third bit
+uint32_t expandBits(uint32_t v) {
+  v = (v * 0x00010001u) & 0xff0000ffu;
+  v = (v * 0x00000101u) & 0x0f00f00fu;
+  v = (v * 0x00000011u) & 0xc30c30c3u;
+  v = (v * 0x00000005u) & 0x49249249u;
+  return v;
+}
+
+// 30 bit morton code of a point in [0, 1]^3, x in the highest bit
+uint32_t mortonCode(const Vector3f &p) {
+  constexpr float SCALE = static_cast<float>(1 << MORTON_BITS);
+  uint32_t code = 0;
+  for (int axis = 0; axis < 3; ++axis) {
+    float x = Clamp(p[axis] * SCALE, 0.0f, SCALE - 1.0f);
+    code |= expandBits(static_cast<uint32_t>(x)) << (2 - axis);
+  }
+  return code;
+}
+
+// sort refs by the morton code of their centroid, the index breaks ties so
+// the order is unique
+void mortonOrder(const Bounds3f &centroid_bounds, std::vector<PrimRef> *refs,
+                 std::vector<uint32_t> *codes) {
+  int count = static_cast<int>(refs->size());
+  std::vector<uint64_t> keys(count);
+  ParallelFor(0, count, BUILD_GRAIN, [&](int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+      uint32_t code = mortonCode(centroid_bounds.Offset((*refs)[i].centroid));
+      keys[i] = static_cast<uint64_t>(code) << 32 | static_cast<uint32_t>(i);
+    }
+  });
+  ParallelSort(keys.begin(), keys.end());
+  std::vector<PrimRef> sorted(count);
+  codes->resize(count);
+  ParallelFor(0, count, BUILD_GRAIN, [&](int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+      sorted[i] = (*refs)[keys[i] & 0xffffffffu];
+      (*codes)[i] = static_cast<uint32_t>(keys[i] >> 32);
+    }
+  });
+  refs->swap(sorted);
+}
+
+// split of a morton sorted range at the highest bit in which its codes
+// differ, false if they are all equal
+bool mortonSplit(const uint32_t *codes, uint32_t begin, uint32_t end,
+                 uint32_t *mid, int *axis) {
+  uint32_t diff = codes[begin] ^ codes[end - 1];
+  if (diff == 0) {
+    return false;
+  }
+  int bit = 31;
+  while (!(diff & (1u << bit))) {
+    --bit;
+  }
+  uint32_t mask = 1u << bit;
+  // the codes share the bits above, so the ones with `bit` set come last
+  *mid = static_cast<uint32_t>(
+      std::partition_point(codes + begin, codes + end,
+                           [mask](uint32_t code) { return !(code & mask); }) -
+      codes);
+  // z owns bits 0, 3, 6, ..., y 1, 4, ... and x 2, 5, ...
+  *axis = 2 - bit % 3;
+  return true;
+}
+
+// the top levels, built in parallel before they are flattened
+struct TopNode {
+  Bounds3f bounds;
+  int axis = 0;
+  std::unique_ptr<TopNode> children[2];
+  // a top leaf holds a serially built subtree with its root at 0
+  std::vector<BvhNode> subtree;
+  // levels of this node and the ones below
+  int depth = 0;
+
+  bool IsLeaf() const { return !children[0]; }
+};
+
+struct TopBuilder {
+  PrimRef *refs;
+  // the morton codes in the order of refs, only for an LBVH build
+  const uint32_t *codes;
+  const BvhSettings &settings;
+  // ranges up to this size become subtrees
+  uint32_t subtree_triangles;
+
+  std::unique_ptr<TopNode> Build(uint32_t begin, uint32_t end, int depth,
+                                 bool morton) const {
+    auto top = std::make_unique<TopNode>();
+    if (end - begin <= subtree_triangles) {
+      top->subtree.resize(1);
+      top->depth =
+          buildSubtree(refs, begin, end, depth, settings, 0, &top->subtree);
+      top->bounds = top->subtree[0].bounds;
+      return top;
+    }
+    Bounds3f centroid_bounds;
+    computeBounds(refs + begin, end - begin, &top->bounds, &centroid_bounds);
+    uint32_t mid;
+    // a range of equal codes continues with SAH splits
+    morton = morton && mortonSplit(codes, begin, end, &mid, &top->axis);
+    if (!morton) {
+      Division division = divide(refs, begin, end, depth, top->bounds,
+                                 centroid_bounds, settings);
+      mid = division.mid;
+      top->axis = division.axis;
+    }
+    TaskGroup group;
+    group.Run([&]() {
+      top->children[0] = Build(begin, mid, depth + 1, morton);
+    });
+    top->children[1] = Build(mid, end, depth + 1, morton);
+    group.Wait();
+    top->depth =
+        1 + std::max(top->children[0]->depth, top->children[1]->depth);
+    return top;
+  }
+};
+
+// top nodes breadth first (so that siblings are adjacent) followed by the
+// subtrees, each one contiguous and without its root which takes the slot of
+// its top leaf. Returns the bytes held by the top nodes and their subtrees
+// when it starts, the subtrees are freed as they are copied
+size_t flatten(TopNode *root, std::vector<BvhNode> *nodes) {
+  std::vector<TopNode *> order{root};
+  std::vector<uint32_t> slots(1);
+  for (size_t i = 0; i < order.size(); ++i) {
+    TopNode *top = order[i];
+    if (!top->IsLeaf()) {
+      slots[i] = static_cast<uint32_t>(order.size());
+      order.push_back(top->children[0].get());
+      order.push_back(top->children[1].get());
+      slots.resize(order.size());
+    }
+  }
+  size_t total = order.size();
+  size_t tree_bytes = order.size() * sizeof(TopNode);
+  for (size_t i = 0; i < order.size(); ++i) {
+    if (order[i]->IsLeaf()) {
+      slots[i] = static_cast<uint32_t>(total);
+      total += order[i]->subtree.size() - 1;
+      tree_bytes += order[i]->subtree.capacity() * sizeof(BvhNode);
+    }
+  }
+  nodes->resize(total);
+  ParallelFor(0, static_cast<int>(order.size()), 1, [&](int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+      TopNode *top = order[i];
+      if (!top->IsLeaf()) {
+        (*nodes)[i] = {top->bounds, slots[i], 0,
+                       static_cast<uint16_t>(top->axis)};
+        continue;
+      }
+      uint32_t base = slots[i];
+      auto relocate = [base](BvhNode node) {
+        if (!node.IsLeaf()) {
+          node.offset = base + node.offset - 1;
+        }
+        return node;
+      };
+      (*nodes)[i] = relocate(top->subtree[0]);
+      for (size_t j = 1; j < top->subtree.size(); ++j) {
+        (*nodes)[base + j - 1] = relocate(top->subtree[j]);
+      }
+      std::vector<BvhNode>().swap(top->subtree);
+    }
+  });
+  return tree_bytes;
+}
+
+double toMiB(size_t bytes) { return bytes / (1024.0 * 1024.0); }
+} // namespace
+
+Bvh::Bvh(const TriangleMesh &mesh, const BvhSettings &settings)
+    : m_mesh(&mesh), m_settings(settings) {
+  if (settings.bin_count < 2 || settings.max_leaf_size < 1 ||
+      settings.max_leaf_size > std::numeric_limits<uint16_t>::max()) {
+    throw RuntimeError("invalid bvh settings, bins: {}, max leaf size: {}",
+                       settings.bin_count, settings.max_leaf_size);
+  }
+  int count = mesh.TriangleCount();
+  if (count == 0) {
+    return;
+  }
+  auto start = std::chrono::steady_clock::now();
+  std::vector<PrimRef> refs(count);
+  ParallelFor(0, count, BUILD_GRAIN, [&](int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+      PrimRef &ref = refs[i];
+      ref.bounds = mesh.TriangleBounds(static_cast<uint32_t>(i));
+      ref.centroid = ref.bounds.Centroid();
+      ref.triangle = static_cast<uint32_t>(i);
+    }
+  });
+  size_t refs_bytes = refs.size() * sizeof(PrimRef);
+  size_t peak_bytes = refs_bytes;
+  std::vector<uint32_t> codes;
+  bool morton = settings.lbvh_min_triangles > 0 &&
+                count >= settings.lbvh_min_triangles;
+  if (morton) {
+    Bounds3f bounds, centroid_bounds;
+    computeBounds(refs.data(), count, &bounds, &centroid_bounds);
+    mortonOrder(centroid_bounds, &refs, &codes);
+    // while sorting: the refs, the morton keys, the codes and the sorted copy
+    peak_bytes += refs.size() * (sizeof(uint64_t) + sizeof(PrimRef)) +
+                  codes.size() * sizeof(uint32_t);
+  }
+
+  TopBuilder builder{refs.data(), codes.data(), settings,
+                     std::max(SUBTREE_TRIANGLES,
+                              static_cast<uint32_t>(settings.max_leaf_size))};
+  std::unique_ptr<TopNode> root =
+      builder.Build(0, static_cast<uint32_t>(count), 0, morton);
+  m_depth = root->depth;
+  size_t tree_bytes = flatten(root.get(), &m_nodes);
+  root.reset();
+  // while flattening: the refs, the codes, the top nodes with their subtrees
+  // and the final nodes
+  peak_bytes = std::max(peak_bytes, refs_bytes +
+                                        codes.size() * sizeof(uint32_t) +
+                                        tree_bytes +
+                                        m_nodes.size() * sizeof(BvhNode));
+  m_triangles.resize(count);
+  ParallelFor(0, count, BUILD_GRAIN, [&](int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+      m_triangles[i] = refs[i].triangle;
+    }
+  });
+  // at the end: the refs, the codes and the finished tree
+  peak_bytes = std::max(peak_bytes, refs_bytes +
+                                        codes.size() * sizeof(uint32_t) +
+                                        MemoryBytes());
+
+  double ms = std::chrono::duration<double, std::milli>(
+                  std::chrono::steady_clock::now() - start)
+                  .count();
+  INFO("bvh: {} triangles, {} nodes, depth {}, sah cost {:.3f}, {} top "
+       "levels, built in {:.1f} ms on {} threads, {:.1f} MiB (build peak "
+       "{:.1f} MiB)",
+       count, m_nodes.size(), m_depth, SahCost(), morton ? "lbvh" : "sah", ms,
+       MaxThreadCount(), toMiB(MemoryBytes()), toMiB(peak_bytes));
+}
+
+Bounds3f Bvh::Bounds() const {
+  return m_nodes.empty() ? Bounds3f() : m_nodes[0].bounds;
+}
+
+size_t Bvh::MemoryBytes() const {
+  return m_nodes.capacity() * sizeof(BvhNode) +
+         m_triangles.capacity() * sizeof(uint32_t);
+}
+
+float Bvh::SahCost() const {
+  if (m_nodes.empty()) {
+    return 0.0f;
+  }
+  double root_area = std::max(m_nodes[0].bounds.SurfaceArea(),
+                              std::numeric_limits<float>::min());
+  double cost = 0.0;
+  for (const BvhNode &node : m_nodes) {
+    double weight = node.bounds.SurfaceArea() / root_area;
+    cost += node.IsLeaf()
+                ? weight * node.count * m_settings.intersection_cost
+                : weight * m_settings.traversal_cost;
+  }
+  return static_cast<float>(cost);
+}
+
+bool Bvh::Intersect(const Ray &ray, RayHit *hit) const {
+  if (m_nodes.empty()) {
+    return false;
+  }
+  Vector3f inv_direction = ray.direction.cwiseInverse();
+  RayHit closest;
+  closest.t = ray.t_max;
+  uint32_t stack[MAX_DEPTH];
+  int stack_size = 0;
+  uint32_t index = 0;
+  while (true) {
+    const BvhNode &node = m_nodes[index];
+    if (node.bounds.Intersect(ray.origin, inv_direction, ray.t_min,
+                              closest.t)) {
+      if (!node.IsLeaf()) {
+        // the near child first, the far one may be culled by then
+        bool negative = inv_direction[node.axis] < 0.0f;
+        stack[stack_size++] = node.offset + (negative ? 0 : 1);
+        index = node.offset + (negative ? 1 : 0);
+        continue;
+      }
+      for (uint32_t i = node.offset; i < node.offset + node.count; ++i) {
+        uint32_t triangle = m_triangles[i];
+        Vector3f p0, p1, p2;
+        m_mesh->TrianglePositions(triangle, &p0, &p1, &p2);
+        if (IntersectTriangle(ray, p0, p1, p2, closest.t, &closest.t,
+                              &closest.u, &closest.v)) {
+          closest.triangle = triangle;
+        }
+      }
+    }
+    if (stack_size == 0) {
+      break;
+    }
+    index = stack[--stack_size];
+  }
+  if (!closest.Valid()) {
+    return false;
+  }
+  *hit = closest;
+  return true;
+}
+
+bool Bvh::Occluded(const Ray &ray) const {
+  if (m_nodes.empty()) {
+    return false;
+  }
+  Vector3f inv_direction = ray.direction.cwiseInverse();
+  uint32_t stack[MAX_DEPTH];
+  int stack_size = 0;
+  uint32_t index = 0;
+  while (true) {
+    const BvhNode &node = m_nodes[index];
+    if (node.bounds.Intersect(ray.origin, inv_direction, ray.t_min,
+                              ray.t_max)) {
+      if (!node.IsLeaf()) {
+        stack[stack_size++] = node.offset + 1;
+        index = node.offset;
+        continue;
+      }
+      for (uint32_t i = node.offset; i < node.offset + node.count; ++i) {
+        Vector3f p0, p1, p2;
+        m_mesh->TrianglePositions(m_triangles[i], &p0, &p1, &p2);
+        float t, u, v;
+        if (IntersectTriangle(ray, p0, p1, p2, ray.t_max, &t, &u, &v)) {
+          return true;
+        }
+      }
+    }
+    if (stack_size == 0) {
+      break;
+    }
+    index = stack[--stack_size];
+  }
+  return false;
+}
+} // namespace lumos
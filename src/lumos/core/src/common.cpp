@@ -1,27 +1,57 @@
 #include "lumos/core/common.h"
 #include "lumos/core/color.h"
 #include "lumos/core/exception.h"
+#include "lumos/core/parallel.h"
 
 #include <filesystem>
 #include <spdlog/logger.h>
+#include <spdlog/pattern_formatter.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
 #include <spdlog/spdlog.h>
 #include <stb_image_write.h>
 
 namespace lumos {
+namespace {
+// %N: the name given by SetThreadName, the thread id for unnamed threads
+class ThreadNameFlag : public spdlog::custom_flag_formatter {
+public:
+  void format(const spdlog::details::log_msg &msg, const std::tm &,
+              spdlog::memory_buf_t &dest) override {
+    const std::string &name = GetThreadName();
+    if (name.empty()) {
+      fmt::format_int id(msg.thread_id);
+      dest.append(id.data(), id.data() + id.size());
+    } else {
+      dest.append(name.data(), name.data() + name.size());
+    }
+  }
+
+  std::unique_ptr<custom_flag_formatter> clone() const override {
+    return std::make_unique<ThreadNameFlag>();
+  }
+};
+} // namespace
 
 std::shared_ptr<spdlog::logger>
 SetupLogger(const std::vector<spdlog::sink_ptr> &sinks) {
   auto logger = spdlog::get(LOGGER_NAME);
   if (!logger) {
     if (sinks.size() > 0) {
+      // the sinks of the caller keep their own formatters
       logger = std::make_shared<spdlog::logger>(LOGGER_NAME, std::begin(sinks),
                                                 std::end(sinks));
       spdlog::register_logger(logger);
     } else {
       // add multi-thread support
       logger = spdlog::stdout_color_mt(LOGGER_NAME);
+      // the default pattern plus the thread name (%N), messages are formatted
+      // on the logging thread
+      auto formatter = std::make_unique<spdlog::pattern_formatter>();
+      formatter->add_flag<ThreadNameFlag>('N').set_pattern(
+          "[%Y-%m-%d %H:%M:%S.%e] [%n] [%^%l%$] [%N] %v");
+      logger->set_formatter(std::move(formatter));
     }
+    EnableWorkerThreadNames();
     spdlog::set_default_logger(logger);
   }
   return logger;
@@ -0,0 +1,522 @@
+#include "lumos/core/convert.h"
+#include "lumos/core/color.h"
+#include "lumos/core/parallel.h"
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+#define LUMOS_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define LUMOS_TARGET_F16C
+#define LUMOS_TARGET_AVX2
+#else
+#define LUMOS_TARGET_F16C __attribute__((target("avx,f16c")))
+#define LUMOS_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace lumos {
+namespace {
+static_assert(sizeof(Imf::Rgba) == 4 * sizeof(uint16_t));
+static_assert(sizeof(Color4f) == 4 * sizeof(float));
+static_assert(sizeof(Color4h) == sizeof(Imf::Rgba));
+
+// rows handed to a single task when converting whole images
+constexpr int CONVERT_GRAIN_ROWS = 16;
+// pixels per stack buffer of the chained conversions, 4 KiB of Color4f stays
+// in L1
+constexpr size_t CONVERT_BATCH = 256;
+
+void halfToFloatScalar(const Imf::Rgba *src, Color4f *dst, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    Imf::Rgba pixel = src[i];
+    dst[i] = ToColor4f(pixel);
+  }
+}
+
+void floatToHalfScalar(const Color4f *src, Imf::Rgba *dst, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    dst[i] = ToImfRgba(src[i]);
+  }
+}
+
+void halfToFloat3Scalar(const Imf::Rgba *src, Color3f *dst, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    Imf::Rgba pixel = src[i];
+    dst[i] = Color3f(pixel.r, pixel.g, pixel.b);
+  }
+}
+
+void float3ToHalfScalar(const Color3f *src, Imf::Rgba *dst, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    const Color3f &c = src[i];
+    dst[i] = Imf::Rgba(c.r(), c.g(), c.b(), 1.0f);
+  }
+}
+
+template <typename Src, typename Dst>
+void accumulateScalar(const Src *src, float weight, Dst *dst, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    Color4f sum = dst[i].template cast<float>() +
+                  weight * src[i].template cast<float>();
+    dst[i] = sum.cast<typename Dst::Scalar>();
+  }
+}
+
+// sRGB encode table: x^(1/2.4) = 2^((e - 127) / 2.4) * m^(1/2.4) with
+// x = 2^(e - 127) * m, m in [1, 2). The exponent factor is exact, the
+// mantissa factor is linearly interpolated over SRGB_SEGMENTS segments
+constexpr int SRGB_SEGMENT_BITS = 7;
+constexpr int SRGB_SEGMENTS = 1 << SRGB_SEGMENT_BITS;
+constexpr int SRGB_FRAC_BITS = 23 - SRGB_SEGMENT_BITS;
+
+struct SrgbTables {
+  std::array<float, 256> exponent;
+  std::array<float, SRGB_SEGMENTS + 1> mantissa;
+  // exact 8-bit decode table, built from the scalar reference
+  std::array<float, 256> decode;
+
+  SrgbTables() {
+    for (int e = 0; e < 255; ++e) {
+      exponent[e] = static_cast<float>(std::pow(2.0, (e - 127) / 2.4));
+    }
+    exponent[255] = INFINITY;
+    for (int i = 0; i <= SRGB_SEGMENTS; ++i) {
+      mantissa[i] = static_cast<float>(
+          std::pow(1.0 + static_cast<double>(i) / SRGB_SEGMENTS, 1.0 / 2.4));
+    }
+    for (int i = 0; i < 256; ++i) {
+      uint8_t v = static_cast<uint8_t>(i);
+      decode[i] = ToLinearRgb(ToFloat(Color4u8(v, v, v, v))).r();
+    }
+  }
+};
+
+const SrgbTables &getSrgbTables() {
+  static SrgbTables tables;
+  return tables;
+}
+
+// same clamping as ToSrgb, only std::pow is replaced by the tables
+inline float encodeSrgb(const SrgbTables &t, float c) {
+  float value = std::max(6.10352e-5f, c);
+  float p = std::max(value, 0.00313067f);
+  uint32_t bits;
+  std::memcpy(&bits, &p, sizeof(bits));
+  uint32_t e = bits >> 23;
+  uint32_t idx = (bits >> SRGB_FRAC_BITS) & (SRGB_SEGMENTS - 1);
+  float frac = static_cast<float>(bits & ((1u << SRGB_FRAC_BITS) - 1)) *
+               (1.0f / (1u << SRGB_FRAC_BITS));
+  float m0 = t.mantissa[idx];
+  float m1 = t.mantissa[idx + 1];
+  float pw = t.exponent[e] * (m0 + frac * (m1 - m0));
+  return std::min(value * 12.92f, pw * 1.055f - 0.055f);
+}
+
+inline uint8_t quantize(float value) {
+  return static_cast<uint8_t>(Clamp(value, 0.0f, 1.0f) * 255.0f);
+}
+
+void linearToSrgbScalar(const Color4f *src, Color4f *dst, size_t count) {
+  const SrgbTables &t = getSrgbTables();
+  for (size_t i = 0; i < count; ++i) {
+    Color4f c = src[i];
+    dst[i] = Color4f(encodeSrgb(t, c.r()), encodeSrgb(t, c.g()),
+                     encodeSrgb(t, c.b()), c.a());
+  }
+}
+
+#ifdef LUMOS_X86
+// 4 pixels per iteration, both loads happen before both stores
+LUMOS_TARGET_F16C void halfToFloatF16c(const Imf::Rgba *src, Color4f *dst,
+                                       size_t count) {
+  const auto *in = reinterpret_cast<const uint16_t *>(src);
+  auto *out = reinterpret_cast<float *>(dst);
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128i h0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + 4 * i));
+    __m128i h1 =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + 4 * i + 8));
+    __m256 f0 = _mm256_cvtph_ps(h0);
+    __m256 f1 = _mm256_cvtph_ps(h1);
+    _mm256_storeu_ps(out + 4 * i, f0);
+    _mm256_storeu_ps(out + 4 * i + 8, f1);
+  }
+  halfToFloatScalar(src + i, dst + i, count - i);
+}
+
+LUMOS_TARGET_F16C void floatToHalfF16c(const Color4f *src, Imf::Rgba *dst,
+                                       size_t count) {
+  const auto *in = reinterpret_cast<const float *>(src);
+  auto *out = reinterpret_cast<uint16_t *>(dst);
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m256 f0 = _mm256_loadu_ps(in + 4 * i);
+    __m256 f1 = _mm256_loadu_ps(in + 4 * i + 8);
+    // round to nearest even, the same as the Imath float -> half conversion
+    __m128i h0 = _mm256_cvtps_ph(f0, _MM_FROUND_TO_NEAREST_INT);
+    __m128i h1 = _mm256_cvtps_ph(f1, _MM_FROUND_TO_NEAREST_INT);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 4 * i), h0);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 4 * i + 8), h1);
+  }
+  floatToHalfScalar(src + i, dst + i, count - i);
+}
+
+// 2 pixels per iteration, the 16 byte store of a pixel spills its alpha into
+// the red of the next pixel which the next store overwrites, so the loop stops
+// one pixel early and the last pixels go scalar
+LUMOS_TARGET_F16C void halfToFloat3F16c(const Imf::Rgba *src, Color3f *dst,
+                                        size_t count) {
+  const auto *in = reinterpret_cast<const uint16_t *>(src);
+  auto *out = reinterpret_cast<float *>(dst);
+  size_t i = 0;
+  for (; i + 3 <= count; i += 2) {
+    __m256 f = _mm256_cvtph_ps(
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + 4 * i)));
+    _mm_storeu_ps(out + 3 * i, _mm256_castps256_ps128(f));
+    _mm_storeu_ps(out + 3 * i + 3, _mm256_extractf128_ps(f, 1));
+  }
+  halfToFloat3Scalar(src + i, dst + i, count - i);
+}
+
+// 2 pixels per iteration, the 16 byte loads read one float past each pixel
+// which is replaced by alpha 1
+LUMOS_TARGET_F16C void float3ToHalfF16c(const Color3f *src, Imf::Rgba *dst,
+                                        size_t count) {
+  const auto *in = reinterpret_cast<const float *>(src);
+  auto *out = reinterpret_cast<uint16_t *>(dst);
+  const __m128 one = _mm_set1_ps(1.0f);
+  size_t i = 0;
+  for (; i + 3 <= count; i += 2) {
+    __m128 p0 = _mm_blend_ps(_mm_loadu_ps(in + 3 * i), one, 0x8);
+    __m128 p1 = _mm_blend_ps(_mm_loadu_ps(in + 3 * i + 3), one, 0x8);
+    __m256 f = _mm256_insertf128_ps(_mm256_castps128_ps256(p0), p1, 1);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 4 * i),
+                     _mm256_cvtps_ph(f, _MM_FROUND_TO_NEAREST_INT));
+  }
+  float3ToHalfScalar(src + i, dst + i, count - i);
+}
+
+// 2 pixels in a ymm register
+LUMOS_TARGET_F16C inline __m256 load2(const Color4f *p) {
+  return _mm256_loadu_ps(reinterpret_cast<const float *>(p));
+}
+
+LUMOS_TARGET_F16C inline __m256 load2(const Color4h *p) {
+  return _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)));
+}
+
+LUMOS_TARGET_F16C inline void store2(Color4f *p, __m256 v) {
+  _mm256_storeu_ps(reinterpret_cast<float *>(p), v);
+}
+
+LUMOS_TARGET_F16C inline void store2(Color4h *p, __m256 v) {
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(p),
+                   _mm256_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT));
+}
+
+// mul + add rather than fma, so that the result matches the scalar path
+template <typename Src, typename Dst>
+LUMOS_TARGET_F16C void accumulateF16c(const Src *src, float weight, Dst *dst,
+                                      size_t count) {
+  const __m256 w = _mm256_set1_ps(weight);
+  size_t i = 0;
+  for (; i + 2 <= count; i += 2) {
+    store2(dst + i,
+           _mm256_add_ps(load2(dst + i), _mm256_mul_ps(w, load2(src + i))));
+  }
+  accumulateScalar(src + i, weight, dst + i, count - i);
+}
+
+// 2 pixels per iteration, the alpha lanes are passed through
+LUMOS_TARGET_AVX2 void linearToSrgbAvx2(const Color4f *src, Color4f *dst,
+                                        size_t count) {
+  const SrgbTables &t = getSrgbTables();
+  const auto *in = reinterpret_cast<const float *>(src);
+  auto *out = reinterpret_cast<float *>(dst);
+  const __m256 min_value = _mm256_set1_ps(6.10352e-5f);
+  const __m256 min_pow = _mm256_set1_ps(0.00313067f);
+  const __m256i segment_mask = _mm256_set1_epi32(SRGB_SEGMENTS - 1);
+  const __m256i frac_mask = _mm256_set1_epi32((1 << SRGB_FRAC_BITS) - 1);
+  const __m256 frac_scale = _mm256_set1_ps(1.0f / (1 << SRGB_FRAC_BITS));
+  size_t i = 0;
+  for (; i + 2 <= count; i += 2) {
+    __m256 x = _mm256_loadu_ps(in + 4 * i);
+    // max(x, min_value) picks min_value for NaN, like std::max(min_value, x)
+    __m256 value = _mm256_max_ps(x, min_value);
+    __m256 p = _mm256_max_ps(value, min_pow);
+    __m256i bits = _mm256_castps_si256(p);
+    __m256i e = _mm256_srli_epi32(bits, 23);
+    __m256i idx =
+        _mm256_and_si256(_mm256_srli_epi32(bits, SRGB_FRAC_BITS), segment_mask);
+    __m256 frac = _mm256_mul_ps(
+        _mm256_cvtepi32_ps(_mm256_and_si256(bits, frac_mask)), frac_scale);
+    __m256 m0 = _mm256_i32gather_ps(t.mantissa.data(), idx, 4);
+    __m256 m1 = _mm256_i32gather_ps(t.mantissa.data() + 1, idx, 4);
+    __m256 ef = _mm256_i32gather_ps(t.exponent.data(), e, 4);
+    __m256 pw = _mm256_mul_ps(
+        ef, _mm256_add_ps(m0, _mm256_mul_ps(frac, _mm256_sub_ps(m1, m0))));
+    __m256 enc = _mm256_sub_ps(_mm256_mul_ps(pw, _mm256_set1_ps(1.055f)),
+                               _mm256_set1_ps(0.055f));
+    __m256 lin = _mm256_mul_ps(value, _mm256_set1_ps(12.92f));
+    __m256 res = _mm256_min_ps(lin, enc);
+    _mm256_storeu_ps(out + 4 * i, _mm256_blend_ps(res, x, 0x88));
+  }
+  linearToSrgbScalar(src + i, dst + i, count - i);
+}
+
+bool detectF16c() {
+#if defined(_MSC_VER) && !defined(__clang__)
+  int info[4];
+  __cpuid(info, 1);
+  bool osxsave = (info[2] & (1 << 27)) != 0;
+  bool avx = (info[2] & (1 << 28)) != 0;
+  bool f16c = (info[2] & (1 << 29)) != 0;
+  // the os has to save the ymm registers as well
+  return osxsave && avx && f16c && (_xgetbv(0) & 0x6) == 0x6;
+#else
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx") && __builtin_cpu_supports("f16c");
+#endif
+}
+
+bool detectAvx2() {
+#if defined(_MSC_VER) && !defined(__clang__)
+  int info[4];
+  // leaf 7 takes its subleaf in ecx
+  __cpuidex(info, 7, 0);
+  return detectF16c() && (info[1] & (1 << 5)) != 0;
+#else
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+#endif
+}
+#else
+bool detectF16c() { return false; }
+bool detectAvx2() { return false; }
+#endif
+
+using HalfToFloatFunc = void (*)(const Imf::Rgba *, Color4f *, size_t);
+using FloatToHalfFunc = void (*)(const Color4f *, Imf::Rgba *, size_t);
+using FloatToFloatFunc = void (*)(const Color4f *, Color4f *, size_t);
+using HalfToFloat3Func = void (*)(const Imf::Rgba *, Color3f *, size_t);
+using Float3ToHalfFunc = void (*)(const Color3f *, Imf::Rgba *, size_t);
+template <typename Src, typename Dst>
+using AccumulateFunc = void (*)(const Src *, float, Dst *, size_t);
+
+struct ConvertKernels {
+  HalfToFloatFunc half_to_float = halfToFloatScalar;
+  FloatToHalfFunc float_to_half = floatToHalfScalar;
+  FloatToFloatFunc linear_to_srgb = linearToSrgbScalar;
+  HalfToFloat3Func half_to_float3 = halfToFloat3Scalar;
+  Float3ToHalfFunc float3_to_half = float3ToHalfScalar;
+  AccumulateFunc<Color4h, Color4f> accumulate_hf = accumulateScalar;
+  AccumulateFunc<Color4f, Color4h> accumulate_fh = accumulateScalar;
+  AccumulateFunc<Color4h, Color4h> accumulate_hh = accumulateScalar;
+  bool f16c = false;
+  bool avx2 = false;
+
+  ConvertKernels() {
+#ifdef LUMOS_X86
+    if (detectF16c()) {
+      half_to_float = halfToFloatF16c;
+      float_to_half = floatToHalfF16c;
+      half_to_float3 = halfToFloat3F16c;
+      float3_to_half = float3ToHalfF16c;
+      accumulate_hf = accumulateF16c;
+      accumulate_fh = accumulateF16c;
+      accumulate_hh = accumulateF16c;
+      f16c = true;
+    }
+    if (detectAvx2()) {
+      linear_to_srgb = linearToSrgbAvx2;
+      avx2 = true;
+    }
+#endif
+    DEBUG("half <-> float conversion kernel: {}", f16c ? "f16c" : "scalar");
+    DEBUG("sRGB encode kernel: {}", avx2 ? "avx2" : "scalar");
+  }
+};
+
+const ConvertKernels &getKernels() {
+  static ConvertKernels kernels;
+  return kernels;
+}
+} // namespace
+
+void HalfToFloat(const Imf::Rgba *src, Color4f *dst, size_t count) {
+  getKernels().half_to_float(src, dst, count);
+}
+
+void FloatToHalf(const Color4f *src, Imf::Rgba *dst, size_t count) {
+  getKernels().float_to_half(src, dst, count);
+}
+
+void HalfToFloat(const Color4h *src, Color4f *dst, size_t count) {
+  HalfToFloat(reinterpret_cast<const Imf::Rgba *>(src), dst, count);
+}
+
+void FloatToHalf(const Color4f *src, Color4h *dst, size_t count) {
+  FloatToHalf(src, reinterpret_cast<Imf::Rgba *>(dst), count);
+}
+
+void Accumulate(const Color4h *src, float weight, Color4f *dst, size_t count) {
+  getKernels().accumulate_hf(src, weight, dst, count);
+}
+
+void Accumulate(const Color4f *src, float weight, Color4h *dst, size_t count) {
+  getKernels().accumulate_fh(src, weight, dst, count);
+}
+
+void Accumulate(const Color4h *src, float weight, Color4h *dst, size_t count) {
+  getKernels().accumulate_hh(src, weight, dst, count);
+}
+
+void HalfToFloat(const Imf::Rgba *src, Color3f *dst, size_t count) {
+  getKernels().half_to_float3(src, dst, count);
+}
+
+void FloatToHalf(const Color3f *src, Imf::Rgba *dst, size_t count) {
+  getKernels().float3_to_half(src, dst, count);
+}
+
+void HalfToLuminance(const Imf::Rgba *src, float *dst, size_t count) {
+  std::array<Color4f, CONVERT_BATCH> buffer;
+  for (size_t i = 0; i < count; i += CONVERT_BATCH) {
+    size_t n = std::min(CONVERT_BATCH, count - i);
+    HalfToFloat(src + i, buffer.data(), n);
+    for (size_t j = 0; j < n; ++j) {
+      dst[i + j] = Luminance(buffer[j]);
+    }
+  }
+}
+
+void LuminanceToHalf(const float *src, Imf::Rgba *dst, size_t count) {
+  std::array<Color4f, CONVERT_BATCH> buffer;
+  for (size_t i = 0; i < count; i += CONVERT_BATCH) {
+    size_t n = std::min(CONVERT_BATCH, count - i);
+    for (size_t j = 0; j < n; ++j) {
+      float v = src[i + j];
+      buffer[j] = Color4f(v, v, v, 1.0f);
+    }
+    FloatToHalf(buffer.data(), dst + i, n);
+  }
+}
+
+void HalfToSrgb8(const Imf::Rgba *src, Color4u8 *dst, size_t count) {
+  std::array<Color4f, CONVERT_BATCH> buffer;
+  for (size_t i = 0; i < count; i += CONVERT_BATCH) {
+    size_t n = std::min(CONVERT_BATCH, count - i);
+    HalfToFloat(src + i, buffer.data(), n);
+    LinearToSrgb8(buffer.data(), dst + i, n);
+  }
+}
+
+void Srgb8ToHalf(const Color4u8 *src, Imf::Rgba *dst, size_t count) {
+  std::array<Color4f, CONVERT_BATCH> buffer;
+  for (size_t i = 0; i < count; i += CONVERT_BATCH) {
+    size_t n = std::min(CONVERT_BATCH, count - i);
+    SrgbToLinear(src + i, buffer.data(), n);
+    FloatToHalf(buffer.data(), dst + i, n);
+  }
+}
+
+bool HasF16c() { return getKernels().f16c; }
+
+void LinearToSrgb(const Color4f *src, Color4f *dst, size_t count) {
+  getKernels().linear_to_srgb(src, dst, count);
+}
+
+void LinearToSrgb8(const Color4f *src, Color4u8 *dst, size_t count) {
+  std::array<Color4f, CONVERT_BATCH> buffer;
+  for (size_t i = 0; i < count; i += CONVERT_BATCH) {
+    size_t n = std::min(CONVERT_BATCH, count - i);
+    LinearToSrgb(src + i, buffer.data(), n);
+    for (size_t j = 0; j < n; ++j) {
+      const Color4f &c = buffer[j];
+      dst[i + j] = Color4u8(quantize(c.r()), quantize(c.g()), quantize(c.b()),
+                            quantize(c.a()));
+    }
+  }
+}
+
+void SrgbToLinear(const Color4u8 *src, Color4f *dst, size_t count) {
+  const SrgbTables &t = getSrgbTables();
+  for (size_t i = 0; i < count; ++i) {
+    Color4u8 c = src[i];
+    dst[i] = Color4f(t.decode[c.r()], t.decode[c.g()], t.decode[c.b()],
+                     static_cast<float>(c.a()) / 255.0f);
+  }
+}
+
+void ToImageData4f(const ImageData4h &src, ImageData4f *dst) {
+  dst->resize(src.rows(), src.cols());
+  size_t width = src.cols();
+  ParallelFor(0, static_cast<int>(src.rows()), CONVERT_GRAIN_ROWS,
+              [&](int begin, int end) {
+                HalfToFloat(src.data() + begin * width,
+                            dst->data() + begin * width, (end - begin) * width);
+              });
+}
+
+void ToImageData4h(const ImageData4f &src, ImageData4h *dst) {
+  dst->resize(src.rows(), src.cols());
+  size_t width = src.cols();
+  ParallelFor(0, static_cast<int>(src.rows()), CONVERT_GRAIN_ROWS,
+              [&](int begin, int end) {
+                FloatToHalf(src.data() + begin * width,
+                            dst->data() + begin * width, (end - begin) * width);
+              });
+}
+
+void ToSrgb(const ImageData4f &src, ImageData4f *dst) {
+  dst->resize(src.rows(), src.cols());
+  size_t width = src.cols();
+  ParallelFor(0, static_cast<int>(src.rows()), CONVERT_GRAIN_ROWS,
+              [&](int begin, int end) {
+                LinearToSrgb(src.data() + begin * width,
+                             dst->data() + begin * width, (end - begin) * width);
+              });
+}
+
+void ToSrgbUint8(const ImageData4f &src, ImageData4u8 *dst) {
+  dst->resize(src.rows(), src.cols());
+  size_t width = src.cols();
+  ParallelFor(0, static_cast<int>(src.rows()), CONVERT_GRAIN_ROWS,
+              [&](int begin, int end) {
+                LinearToSrgb8(src.data() + begin * width,
+                              dst->data() + begin * width,
+                              (end - begin) * width);
+              });
+}
+
+void ToLinearRgb(const ImageData4u8 &src, ImageData4f *dst) {
+  dst->resize(src.rows(), src.cols());
+  size_t width = src.cols();
+  ParallelFor(0, static_cast<int>(src.rows()), CONVERT_GRAIN_ROWS,
+              [&](int begin, int end) {
+                SrgbToLinear(src.data() + begin * width,
+                             dst->data() + begin * width, (end - begin) * width);
+              });
+}
+void QuantizeUint8(const ImageData4f &src, ImageData4u8 *dst) {
+  ImageData4u8 result(src.rows(), src.cols());
+  size_t width = src.cols();
+  ParallelFor(0, static_cast<int>(src.rows()), CONVERT_GRAIN_ROWS,
+              [&](int begin, int end) {
+                const Color4f *in = src.data() + begin * width;
+                Color4u8 *out = result.data() + begin * width;
+                for (size_t i = 0; i < (end - begin) * width; ++i) {
+                  Color4f v = in[i].cwiseMax(0.0f).cwiseMin(1.0f) * 255.0f +
+                              Color4f::Constant(0.5f);
+                  out[i] = v.cast<uint8_t>();
+                }
+              });
+  *dst = std::move(result);
+}
+} // namespace lumos
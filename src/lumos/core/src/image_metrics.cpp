@@ -0,0 +1,479 @@
+#include "lumos/core/image_metrics.h"
+#include "lumos/core/exception.h"
+#include "lumos/core/imageio.h"
+#include "lumos/core/parallel.h"
+#include "lumos/core/planar_image.h"
+
+#include <array>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <vector>
+
+namespace lumos {
+namespace {
+constexpr int METRIC_GRAIN_ROWS = 16;
+
+// contrast sensitivity of the FLIP model as gaussians, b in deg^2 of
+// a * sqrt(pi / b) * exp(-pi^2 x^2 / b) (the first lobe of each channel)
+constexpr float FLIP_CSF_B_ACHROMATIC = 0.0047f;
+constexpr float FLIP_CSF_B_RED_GREEN = 0.0053f;
+constexpr float FLIP_CSF_B_BLUE_YELLOW = 0.04f;
+// edge detector width in degrees, the gaussian sigma is half of it
+constexpr float FLIP_EDGE_WIDTH = 0.082f;
+constexpr float FLIP_HYAB_EXPONENT = 0.7f;
+constexpr float FLIP_FEATURE_EXPONENT = 0.5f;
+// color error compression: errors below PC * cmax map linearly to [0, PT]
+constexpr float FLIP_PC = 0.4f;
+constexpr float FLIP_PT = 0.95f;
+
+// D65 reference white
+constexpr float WHITE_X = 0.950428545f;
+constexpr float WHITE_Z = 1.088900371f;
+
+void checkSameSize(const ImageData4f &image, const ImageData4f &reference) {
+  if (image.rows() != reference.rows() || image.cols() != reference.cols()) {
+    throw RuntimeError("image size mismatch, image(hxw): {}x{}, "
+                       "reference(hxw): {}x{}",
+                       image.rows(), image.cols(), reference.rows(),
+                       reference.cols());
+  }
+}
+
+// sum of row_sum(y) over [0, rows), rows in parallel, added in row order
+template <typename Func> double sumRows(int rows, Func &&row_sum) {
+  std::vector<double> sums(rows);
+  ParallelFor(0, rows, METRIC_GRAIN_ROWS, [&](int begin, int end) {
+    for (int y = begin; y < end; ++y) {
+      sums[y] = row_sum(y);
+    }
+  });
+  return std::accumulate(sums.begin(), sums.end(), 0.0);
+}
+
+// the error map row `y`, or null
+float *errorRow(ImageData1f *error_map, int y) {
+  return error_map
+             ? error_map->data() + static_cast<std::ptrdiff_t>(y) *
+                                       error_map->cols()
+             : nullptr;
+}
+
+// mean over pixels of func(image pixel, reference pixel) -> per pixel error
+template <typename Func>
+double meanError(const ImageData4f &image, const ImageData4f &reference,
+                 ImageData1f *error_map, Func &&func) {
+  checkSameSize(image, reference);
+  int rows = static_cast<int>(image.rows());
+  int cols = static_cast<int>(image.cols());
+  if (error_map) {
+    error_map->resize(rows, cols);
+  }
+  if (image.size() == 0) {
+    return 0.0;
+  }
+  double sum = sumRows(rows, [&](int y) {
+    const Color4f *a = image.data() + static_cast<std::ptrdiff_t>(y) * cols;
+    const Color4f *b = reference.data() + static_cast<std::ptrdiff_t>(y) * cols;
+    float *error = errorRow(error_map, y);
+    // a row is short enough to be summed in float
+    float row = 0.0f;
+    for (int x = 0; x < cols; ++x) {
+      float e = func(a[x], b[x]);
+      row += e;
+      if (error) {
+        error[x] = e;
+      }
+    }
+    return static_cast<double>(row);
+  });
+  return sum / static_cast<double>(image.size());
+}
+
+// out[x] = sum_k weights[k] * in[x + k - radius], edges clamped
+struct Kernel {
+  int radius{};
+  std::vector<float> weights;
+};
+
+Kernel gaussianKernel(float sigma) {
+  Kernel kernel;
+  kernel.radius = std::max(1, static_cast<int>(std::ceil(3.0f * sigma)));
+  float sum = 0.0f;
+  for (int i = -kernel.radius; i <= kernel.radius; ++i) {
+    float w = std::exp(-static_cast<float>(i * i) / (2.0f * sigma * sigma));
+    kernel.weights.push_back(w);
+    sum += w;
+  }
+  for (float &w : kernel.weights) {
+    w /= sum;
+  }
+  return kernel;
+}
+
+// first derivative of a gaussian, positive and negative lobes normalized to
+// 1 and -1 (as FLIP does)
+Kernel gaussianDerivativeKernel(float sigma) {
+  Kernel kernel = gaussianKernel(sigma);
+  float positive = 0.0f;
+  for (int i = -kernel.radius; i <= kernel.radius; ++i) {
+    float &w = kernel.weights[i + kernel.radius];
+    w *= -static_cast<float>(i);
+    positive += std::max(w, 0.0f);
+  }
+  for (float &w : kernel.weights) {
+    w /= positive;
+  }
+  return kernel;
+}
+
+// separable filter of one plane in place, `tmp` is scratch storage
+void filterPlane(PlanarImagef *image, int channel, const Kernel &kx,
+                 const Kernel &ky, PlanarImagef *tmp) {
+  using ArrayMap = Eigen::Map<Eigen::ArrayXf>;
+  using ConstArrayMap = Eigen::Map<const Eigen::ArrayXf>;
+  int rows = image->Rows();
+  int cols = image->Cols();
+  tmp->Resize(1, rows, cols);
+  ParallelFor(0, rows, METRIC_GRAIN_ROWS, [&](int begin, int end) {
+    std::vector<float> pad(cols + 2 * kx.radius);
+    for (int y = begin; y < end; ++y) {
+      const float *in = image->Row(channel, y);
+      for (int i = 0; i < static_cast<int>(pad.size()); ++i) {
+        pad[i] = in[Clamp(i - kx.radius, 0, cols - 1)];
+      }
+      ArrayMap out(tmp->Row(0, y), cols);
+      out = kx.weights[0] * ConstArrayMap(pad.data(), cols);
+      for (size_t k = 1; k < kx.weights.size(); ++k) {
+        out += kx.weights[k] * ConstArrayMap(pad.data() + k, cols);
+      }
+    }
+  });
+  ParallelFor(0, rows, METRIC_GRAIN_ROWS, [&](int begin, int end) {
+    for (int y = begin; y < end; ++y) {
+      ArrayMap out(image->Row(channel, y), cols);
+      for (size_t k = 0; k < ky.weights.size(); ++k) {
+        int src = Clamp(y + static_cast<int>(k) - ky.radius, 0, rows - 1);
+        ConstArrayMap in(tmp->Row(0, src), cols);
+        if (k == 0) {
+          out = ky.weights[k] * in;
+        } else {
+          out += ky.weights[k] * in;
+        }
+      }
+    }
+  });
+}
+
+// linear sRGB <-> CIE XYZ (D65)
+Eigen::Vector3f rgbToXyz(const Eigen::Vector3f &rgb) {
+  static const Eigen::Matrix3f m =
+      (Eigen::Matrix3f() << 0.4124564f, 0.3575761f, 0.1804375f, //
+       0.2126729f, 0.7151522f, 0.0721750f,                      //
+       0.0193339f, 0.1191920f, 0.9503041f)
+          .finished();
+  return m * rgb;
+}
+
+Eigen::Vector3f xyzToRgb(const Eigen::Vector3f &xyz) {
+  static const Eigen::Matrix3f m =
+      (Eigen::Matrix3f() << 3.2404542f, -1.5371385f, -0.4985314f, //
+       -0.9692660f, 1.8760108f, 0.0415560f,                       //
+       0.0556434f, -0.2040259f, 1.0572252f)
+          .finished();
+  return m * xyz;
+}
+
+// the linearized L*a*b* FLIP filters in
+Eigen::Vector3f rgbToYcxcz(const Color4f &c) {
+  Eigen::Vector3f rgb = c.head<3>().cwiseMax(0.0f).cwiseMin(1.0f);
+  Eigen::Vector3f xyz = rgbToXyz(rgb);
+  float y = xyz[1];
+  return {116.0f * y - 16.0f, 500.0f * (xyz[0] / WHITE_X - y),
+          200.0f * (y - xyz[2] / WHITE_Z)};
+}
+
+Eigen::Vector3f ycxczToRgb(const Eigen::Vector3f &ycc) {
+  float y = (ycc[0] + 16.0f) / 116.0f;
+  Eigen::Vector3f xyz(WHITE_X * (ycc[1] / 500.0f + y), y,
+                      WHITE_Z * (y - ycc[2] / 200.0f));
+  return xyzToRgb(xyz);
+}
+
+float labF(float t) {
+  constexpr float delta = 6.0f / 29.0f;
+  return t > delta * delta * delta ? std::cbrt(t)
+                                   : t / (3.0f * delta * delta) + 4.0f / 29.0f;
+}
+
+// L*a*b* with a* and b* scaled by 0.01 L* (Hunt effect)
+Eigen::Vector3f rgbToHuntLab(const Eigen::Vector3f &rgb) {
+  Eigen::Vector3f xyz = rgbToXyz(rgb.cwiseMax(0.0f).cwiseMin(1.0f));
+  float fx = labF(xyz[0] / WHITE_X);
+  float fy = labF(xyz[1]);
+  float fz = labF(xyz[2] / WHITE_Z);
+  float l = 116.0f * fy - 16.0f;
+  return {l, 0.01f * l * 500.0f * (fx - fy), 0.01f * l * 200.0f * (fy - fz)};
+}
+
+float hyab(const Eigen::Vector3f &a, const Eigen::Vector3f &b) {
+  Eigen::Vector3f d = a - b;
+  return std::abs(d[0]) + std::sqrt(d[1] * d[1] + d[2] * d[2]);
+}
+
+// FLIP's color error of two filtered pixels in [0, 1]
+float flipColorError(const Eigen::Vector3f &a, const Eigen::Vector3f &b,
+                     float cmax) {
+  float e = std::pow(hyab(a, b), FLIP_HYAB_EXPONENT);
+  if (e < FLIP_PC * cmax) {
+    return FLIP_PT / (FLIP_PC * cmax) * e;
+  }
+  return std::min(1.0f, FLIP_PT + (e - FLIP_PC * cmax) /
+                                      (cmax - FLIP_PC * cmax) *
+                                      (1.0f - FLIP_PT));
+}
+
+// normalized luminance of the clamped image
+float flipLuminance(const Color4f &c) {
+  return (rgbToYcxcz(c)[0] + 16.0f) / 116.0f;
+}
+
+// the sRGB encoded magma color map at 0, 1/8, ..., 1
+constexpr std::array<std::array<float, 3>, 9> MAGMA{{
+    {0.001462f, 0.000466f, 0.013866f},
+    {0.078815f, 0.054184f, 0.211667f},
+    {0.232077f, 0.059889f, 0.437695f},
+    {0.390384f, 0.100379f, 0.501864f},
+    {0.550287f, 0.161158f, 0.505719f},
+    {0.716387f, 0.214982f, 0.475290f},
+    {0.868793f, 0.287728f, 0.409303f},
+    {0.967671f, 0.439703f, 0.359810f},
+    {0.987053f, 0.991438f, 0.749504f},
+}};
+} // namespace
+
+double Mse(const ImageData4f &image, const ImageData4f &reference,
+           ImageData1f *error_map) {
+  const Color4f rgb(1.0f, 1.0f, 1.0f, 0.0f);
+  return meanError(image, reference, error_map,
+                   [rgb](const Color4f &a, const Color4f &b) {
+                     Color4f d = (a - b).cwiseProduct(rgb);
+                     return d.squaredNorm() * (1.0f / 3.0f);
+                   });
+}
+
+double RelMse(const ImageData4f &image, const ImageData4f &reference,
+              ImageData1f *error_map) {
+  const Color4f rgb(1.0f, 1.0f, 1.0f, 0.0f);
+  return meanError(
+      image, reference, error_map, [rgb](const Color4f &a, const Color4f &b) {
+        Color4f d = (a - b).cwiseProduct(rgb);
+        Color4f e = d.cwiseProduct(d).cwiseQuotient(
+            b.cwiseProduct(b) + Color4f::Constant(RELMSE_EPSILON));
+        return e.sum() * (1.0f / 3.0f);
+      });
+}
+
+double Psnr(const ImageData4f &image, const ImageData4f &reference,
+            float peak) {
+  double mse = Mse(image, reference);
+  if (mse == 0.0) {
+    return std::numeric_limits<double>::infinity();
+  }
+  return 10.0 * std::log10(static_cast<double>(peak) * peak / mse);
+}
+
+double Ssim(const ImageData4f &image, const ImageData4f &reference,
+            ImageData1f *error_map, const SsimSettings &settings) {
+  checkSameSize(image, reference);
+  int rows = static_cast<int>(image.rows());
+  int cols = static_cast<int>(image.cols());
+  if (error_map) {
+    error_map->resize(rows, cols);
+  }
+  if (image.size() == 0) {
+    return 1.0;
+  }
+  // x, y, x^2, y^2, xy, all gaussian filtered
+  PlanarImagef moments(5, rows, cols);
+  ParallelFor(0, rows, METRIC_GRAIN_ROWS, [&](int begin, int end) {
+    for (int y = begin; y < end; ++y) {
+      for (int x = 0; x < cols; ++x) {
+        float a = Luminance(image(y, x));
+        float b = Luminance(reference(y, x));
+        moments.Row(0, y)[x] = a;
+        moments.Row(1, y)[x] = b;
+        moments.Row(2, y)[x] = a * a;
+        moments.Row(3, y)[x] = b * b;
+        moments.Row(4, y)[x] = a * b;
+      }
+    }
+  });
+  Kernel window = gaussianKernel(settings.sigma);
+  PlanarImagef tmp;
+  for (int c = 0; c < moments.Channels(); ++c) {
+    filterPlane(&moments, c, window, window, &tmp);
+  }
+  float c1 = settings.k1 * settings.dynamic_range;
+  float c2 = settings.k2 * settings.dynamic_range;
+  c1 *= c1;
+  c2 *= c2;
+  double sum = sumRows(rows, [&](int y) {
+    const float *mx = moments.Row(0, y);
+    const float *my = moments.Row(1, y);
+    const float *xx = moments.Row(2, y);
+    const float *yy = moments.Row(3, y);
+    const float *xy = moments.Row(4, y);
+    float *error = errorRow(error_map, y);
+    float row = 0.0f;
+    for (int x = 0; x < cols; ++x) {
+      float vx = xx[x] - mx[x] * mx[x];
+      float vy = yy[x] - my[x] * my[x];
+      float cov = xy[x] - mx[x] * my[x];
+      float s = ((2.0f * mx[x] * my[x] + c1) * (2.0f * cov + c2)) /
+                ((mx[x] * mx[x] + my[x] * my[x] + c1) * (vx + vy + c2));
+      row += s;
+      if (error) {
+        error[x] = s;
+      }
+    }
+    return static_cast<double>(row);
+  });
+  return sum / static_cast<double>(image.size());
+}
+
+double Flip(const ImageData4f &image, const ImageData4f &reference,
+            ImageData1f *error_map, const FlipSettings &settings) {
+  checkSameSize(image, reference);
+  int rows = static_cast<int>(image.rows());
+  int cols = static_cast<int>(image.cols());
+  if (error_map) {
+    error_map->resize(rows, cols);
+  }
+  if (image.size() == 0) {
+    return 0.0;
+  }
+  float ppd = settings.pixels_per_degree;
+  PlanarImagef tmp;
+
+  // edges: gradient magnitude of the normalized luminance, channels are
+  // d/dx and d/dy of the image, then of the reference
+  PlanarImagef feature(4, rows, cols);
+  ParallelFor(0, rows, METRIC_GRAIN_ROWS, [&](int begin, int end) {
+    for (int y = begin; y < end; ++y) {
+      for (int x = 0; x < cols; ++x) {
+        float a = flipLuminance(image(y, x));
+        float b = flipLuminance(reference(y, x));
+        feature.Row(0, y)[x] = a;
+        feature.Row(1, y)[x] = a;
+        feature.Row(2, y)[x] = b;
+        feature.Row(3, y)[x] = b;
+      }
+    }
+  });
+  float edge_sigma = 0.5f * FLIP_EDGE_WIDTH * ppd;
+  Kernel gauss = gaussianKernel(edge_sigma);
+  Kernel derivative = gaussianDerivativeKernel(edge_sigma);
+  for (int c = 0; c < 4; c += 2) {
+    filterPlane(&feature, c, derivative, gauss, &tmp);
+    filterPlane(&feature, c + 1, gauss, derivative, &tmp);
+  }
+  // the feature difference replaces the d/dx plane of the image
+  ParallelFor(0, rows, METRIC_GRAIN_ROWS, [&](int begin, int end) {
+    for (int y = begin; y < end; ++y) {
+      float *out = feature.Row(0, y);
+      for (int x = 0; x < cols; ++x) {
+        float a = std::hypot(out[x], feature.Row(1, y)[x]);
+        float b = std::hypot(feature.Row(2, y)[x], feature.Row(3, y)[x]);
+        out[x] = std::pow(std::abs(a - b) * INV_SQRT_TWO,
+                          FLIP_FEATURE_EXPONENT);
+      }
+    }
+  });
+
+  // color: YCxCz filtered by the contrast sensitivity of each channel
+  std::array<Kernel, 3> csf;
+  for (int c = 0; c < 3; ++c) {
+    float b = c == 0   ? FLIP_CSF_B_ACHROMATIC
+              : c == 1 ? FLIP_CSF_B_RED_GREEN
+                       : FLIP_CSF_B_BLUE_YELLOW;
+    csf[c] = gaussianKernel(std::sqrt(b / (2.0f * PI * PI)) * ppd);
+  }
+  std::array<PlanarImagef, 2> ycc{PlanarImagef(3, rows, cols),
+                                  PlanarImagef(3, rows, cols)};
+  for (int i = 0; i < 2; ++i) {
+    const ImageData4f &src = i == 0 ? image : reference;
+    PlanarImagef &dst = ycc[i];
+    ParallelFor(0, rows, METRIC_GRAIN_ROWS, [&](int begin, int end) {
+      for (int y = begin; y < end; ++y) {
+        for (int x = 0; x < cols; ++x) {
+          Eigen::Vector3f v = rgbToYcxcz(src(y, x));
+          for (int c = 0; c < 3; ++c) {
+            dst.Row(c, y)[x] = v[c];
+          }
+        }
+      }
+    });
+    for (int c = 0; c < 3; ++c) {
+      filterPlane(&dst, c, csf[c], csf[c], &tmp);
+    }
+  }
+
+  float cmax = std::pow(hyab(rgbToHuntLab({0.0f, 1.0f, 0.0f}),
+                             rgbToHuntLab({0.0f, 0.0f, 1.0f})),
+                        FLIP_HYAB_EXPONENT);
+  double sum = sumRows(rows, [&](int y) {
+    float *error = errorRow(error_map, y);
+    float row = 0.0f;
+    for (int x = 0; x < cols; ++x) {
+      Eigen::Vector3f a(ycc[0].Row(0, y)[x], ycc[0].Row(1, y)[x],
+                        ycc[0].Row(2, y)[x]);
+      Eigen::Vector3f b(ycc[1].Row(0, y)[x], ycc[1].Row(1, y)[x],
+                        ycc[1].Row(2, y)[x]);
+      float color = flipColorError(rgbToHuntLab(ycxczToRgb(a)),
+                                   rgbToHuntLab(ycxczToRgb(b)), cmax);
+      float e = std::pow(color, 1.0f - feature.Row(0, y)[x]);
+      row += e;
+      if (error) {
+        error[x] = e;
+      }
+    }
+    return static_cast<double>(row);
+  });
+  return sum / static_cast<double>(image.size());
+}
+
+void ErrorHeatmap(const ImageData1f &error_map, ImageData4f *heatmap,
+                  float max_error) {
+  std::array<Color4f, MAGMA.size()> colors;
+  for (size_t i = 0; i < MAGMA.size(); ++i) {
+    colors[i] = ToLinearRgb(
+        Color4f(MAGMA[i][0], MAGMA[i][1], MAGMA[i][2], 1.0f));
+  }
+  int rows = static_cast<int>(error_map.rows());
+  int cols = static_cast<int>(error_map.cols());
+  float scale = max_error > 0.0f ? 1.0f / max_error : 0.0f;
+  ImageData4f result(rows, cols);
+  ParallelFor(0, rows, METRIC_GRAIN_ROWS, [&](int begin, int end) {
+    for (int y = begin; y < end; ++y) {
+      for (int x = 0; x < cols; ++x) {
+        // NaN errors show up as the maximum
+        float t = error_map(y, x) * scale;
+        t = t >= 0.0f ? std::min(t, 1.0f) : (t < 0.0f ? 0.0f : 1.0f);
+        float f = t * static_cast<float>(MAGMA.size() - 1);
+        int i = std::min(static_cast<int>(f), static_cast<int>(MAGMA.size()) - 2);
+        f -= static_cast<float>(i);
+        result(y, x) = (1.0f - f) * colors[i] + f * colors[i + 1];
+      }
+    }
+  });
+  *heatmap = std::move(result);
+}
+
+void SaveErrorHeatmap(const std::filesystem::path &output,
+                      const ImageData1f &error_map, float max_error) {
+  ImageData4f heatmap;
+  ErrorHeatmap(error_map, &heatmap, max_error);
+  SaveExr(output, heatmap);
+}
+} // namespace lumos
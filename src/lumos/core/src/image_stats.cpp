@@ -0,0 +1,220 @@
+#include "lumos/core/image_stats.h"
+#include "lumos/core/convert.h"
+#include "lumos/core/exception.h"
+#include "lumos/core/parallel.h"
+
+#include <tbb/enumerable_thread_specific.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <type_traits>
+
+namespace lumos {
+namespace {
+// rows per partial, fixed so that the partial float sums are the same and
+// are added in the same order however the rows are spread over the threads.
+// The integer histogram counts do not depend on the order and are kept per
+// thread instead, one histogram per block would cost rows / 16 x bins
+constexpr int STATS_BLOCK_ROWS = 16;
+
+// maps a luminance to its histogram bin
+struct Binning {
+  int bins;
+  bool log_bins;
+  float offset;
+  float scale;
+
+  Binning(const ImageStatsSettings &settings)
+      : bins(settings.histogram_bins), log_bins(settings.log_bins) {
+    float lo = log_bins ? std::log2(settings.histogram_min)
+                        : settings.histogram_min;
+    float hi = log_bins ? std::log2(settings.histogram_max)
+                        : settings.histogram_max;
+    offset = lo;
+    scale = static_cast<float>(bins) / (hi - lo);
+  }
+
+  int operator()(float luminance) const {
+    float x = luminance;
+    if (log_bins) {
+      // log2 of zero or negative is -inf / NaN, both land in the first bin
+      x = luminance > 0.0f ? std::log2(luminance) : -INFINITY;
+    }
+    float t = (x - offset) * scale;
+    if (!(t >= 0.0f)) {
+      return 0;
+    }
+    return t >= static_cast<float>(bins) ? bins - 1 : static_cast<int>(t);
+  }
+};
+
+// the sums of one block of rows (the histogram is counted per thread),
+// padded to a cache line so that neighbouring partials do not share one
+struct alignas(64) Partial {
+  size_t nan_count{};
+  size_t inf_count{};
+  size_t finite_count{};
+  Color4f min = Color4f::Constant(std::numeric_limits<float>::infinity());
+  Color4f max = Color4f::Constant(-std::numeric_limits<float>::infinity());
+  Eigen::Vector4d sum = Eigen::Vector4d::Zero();
+  float min_luminance = std::numeric_limits<float>::infinity();
+  float max_luminance = -std::numeric_limits<float>::infinity();
+  double sum_luminance{};
+  double sum_log_luminance{};
+};
+
+void accumulate(const Color4f *pixels, int count, const Binning &binning,
+                Partial *partial, uint64_t *histogram) {
+  for (int i = 0; i < count; ++i) {
+    const Color4f &c = pixels[i];
+    // x - x is 0 for finite x and NaN for inf and NaN
+    if (!((c - c).array() == 0.0f).all()) {
+      if (c.array().isNaN().any()) {
+        ++partial->nan_count;
+      } else {
+        ++partial->inf_count;
+      }
+      continue;
+    }
+    ++partial->finite_count;
+    partial->min = partial->min.cwiseMin(c);
+    partial->max = partial->max.cwiseMax(c);
+    partial->sum += c.cast<double>();
+    float luminance = Luminance(c);
+    partial->min_luminance = std::min(partial->min_luminance, luminance);
+    partial->max_luminance = std::max(partial->max_luminance, luminance);
+    partial->sum_luminance += luminance;
+    partial->sum_log_luminance +=
+        std::log(ImageStats::LOG_AVERAGE_DELTA + std::max(luminance, 0.0f));
+    ++histogram[binning(luminance)];
+  }
+}
+
+template <typename Pixel>
+void computeImageStats(const ImageData<Pixel> &image, ImageStats *stats,
+                       const ImageStatsSettings &settings) {
+  if (settings.histogram_bins <= 0 ||
+      !(settings.histogram_max > settings.histogram_min) ||
+      (settings.log_bins && !(settings.histogram_min > 0.0f))) {
+    throw RuntimeError("invalid histogram, bins: {}, range: [{}, {}]",
+                       settings.histogram_bins, settings.histogram_min,
+                       settings.histogram_max);
+  }
+  int rows = static_cast<int>(image.rows());
+  int cols = static_cast<int>(image.cols());
+  Binning binning(settings);
+  int blocks = (rows + STATS_BLOCK_ROWS - 1) / STATS_BLOCK_ROWS;
+  std::vector<Partial> partials(blocks);
+  tbb::enumerable_thread_specific<std::vector<uint64_t>> histograms(
+      [&]() { return std::vector<uint64_t>(settings.histogram_bins, 0); });
+  ParallelFor(0, blocks, 1, [&](int begin, int end) {
+    uint64_t *histogram = histograms.local().data();
+    // half rows are widened into this
+    std::vector<Color4f> widened;
+    for (int b = begin; b < end; ++b) {
+      Partial &partial = partials[b];
+      int last = std::min(rows, (b + 1) * STATS_BLOCK_ROWS);
+      for (int y = b * STATS_BLOCK_ROWS; y < last; ++y) {
+        const Pixel *row =
+            image.data() + static_cast<std::ptrdiff_t>(y) * cols;
+        if constexpr (std::is_same_v<Pixel, Color4f>) {
+          accumulate(row, cols, binning, &partial, histogram);
+        } else {
+          widened.resize(cols);
+          HalfToFloat(row, widened.data(), cols);
+          accumulate(widened.data(), cols, binning, &partial, histogram);
+        }
+      }
+    }
+  });
+
+  // merged in row order
+  Partial total;
+  for (const auto &partial : partials) {
+    total.nan_count += partial.nan_count;
+    total.inf_count += partial.inf_count;
+    total.finite_count += partial.finite_count;
+    total.min = total.min.cwiseMin(partial.min);
+    total.max = total.max.cwiseMax(partial.max);
+    total.sum += partial.sum;
+    total.min_luminance = std::min(total.min_luminance, partial.min_luminance);
+    total.max_luminance = std::max(total.max_luminance, partial.max_luminance);
+    total.sum_luminance += partial.sum_luminance;
+    total.sum_log_luminance += partial.sum_log_luminance;
+  }
+  std::vector<uint64_t> histogram(settings.histogram_bins, 0);
+  histograms.combine_each([&](const std::vector<uint64_t> &local) {
+    for (int i = 0; i < settings.histogram_bins; ++i) {
+      histogram[i] += local[i];
+    }
+  });
+
+  ImageStats result;
+  result.pixel_count = static_cast<size_t>(rows) * cols;
+  result.nan_count = total.nan_count;
+  result.inf_count = total.inf_count;
+  // everything stays zero when there is no finite pixel
+  if (total.finite_count > 0) {
+    double n = static_cast<double>(total.finite_count);
+    result.min = total.min;
+    result.max = total.max;
+    result.mean = Color4f((total.sum / n).cast<float>());
+    result.min_luminance = total.min_luminance;
+    result.max_luminance = total.max_luminance;
+    result.mean_luminance = static_cast<float>(total.sum_luminance / n);
+    result.log_average_luminance =
+        static_cast<float>(std::exp(total.sum_log_luminance / n));
+  }
+  result.histogram = std::move(histogram);
+  result.log_bins = settings.log_bins;
+  result.histogram_min = settings.histogram_min;
+  result.histogram_max = settings.histogram_max;
+  *stats = std::move(result);
+}
+} // namespace
+
+float ImageStats::BinEdge(int i) const {
+  float t = static_cast<float>(i) / static_cast<float>(histogram.size());
+  if (log_bins) {
+    float lo = std::log2(histogram_min);
+    float hi = std::log2(histogram_max);
+    return std::exp2(lo + t * (hi - lo));
+  }
+  return histogram_min + t * (histogram_max - histogram_min);
+}
+
+float ImageStats::LuminancePercentile(float p) const {
+  size_t count = FinitePixelCount();
+  if (count == 0 || histogram.empty()) {
+    return 0.0f;
+  }
+  double target = static_cast<double>(Clamp(p, 0.0f, 1.0f)) * count;
+  double below = 0.0;
+  int bins = static_cast<int>(histogram.size());
+  for (int i = 0; i < bins; ++i) {
+    double next = below + static_cast<double>(histogram[i]);
+    if (next >= target && histogram[i] > 0) {
+      float t = static_cast<float>((target - below) / histogram[i]);
+      float lo = BinEdge(i);
+      float hi = BinEdge(i + 1);
+      float value = log_bins ? lo * std::exp2(t * std::log2(hi / lo))
+                             : lo + t * (hi - lo);
+      // the open ended first and last bins are bounded by the actual range
+      return Clamp(value, min_luminance, max_luminance);
+    }
+    below = next;
+  }
+  return max_luminance;
+}
+
+void ComputeImageStats(const ImageData4f &image, ImageStats *stats,
+                       const ImageStatsSettings &settings) {
+  computeImageStats(image, stats, settings);
+}
+
+void ComputeImageStats(const ImageData4h &image, ImageStats *stats,
+                       const ImageStatsSettings &settings) {
+  computeImageStats(image, stats, settings);
+}
+} // namespace lumos
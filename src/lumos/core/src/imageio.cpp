@@ -1,32 +1,154 @@
 #include "lumos/core/imageio.h"
+#include "lumos/core/buffer_pool.h"
 #include "lumos/core/color.h"
 #include "lumos/core/common.h"
+#include "lumos/core/convert.h"
 #include "lumos/core/exception.h"
+#include "lumos/core/mapped_file.h"
+#include "lumos/core/parallel.h"
 
+#include <Iex.h>
+#include <ImfChannelList.h>
+#include <ImfFrameBuffer.h>
+#include <ImfHeader.h>
+#include <ImfIO.h>
+#include <ImfInputPart.h>
+#include <ImfMultiPartInputFile.h>
+#include <ImfMultiPartOutputFile.h>
+#include <ImfOutputPart.h>
+#include <ImfPartType.h>
 #include <ImfRgba.h>
 #include <ImfRgbaFile.h>
+#include <ImfTestFile.h>
+#include <ImfThreading.h>
+#include <ImfTiledRgbaFile.h>
+#include <algorithm>
+#include <atomic>
+#include <climits>
 #include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
 #include <stb_image.h>
-#include <stb_image_write.h>
-#include <type_traits>
+#include <tbb/task_arena.h>
+#include <thread>
+#include <vector>
+#include <zlib.h>
 #include <spdlog/fmt/ostr.h>
 
 namespace lumos {
-void ReadPng(const std::filesystem::path &input, ImageData4u8 *output) {
+namespace {
+std::atomic<int> g_io_thread_count{0};
+std::atomic<bool> g_io_memory_mapping{true};
+std::once_flag g_exr_thread_pool_flag;
+
+int resolveThreadCount(int count) {
+  return count > 0
+             ? count
+             : std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+}
+
+// OpenEXR counts worker threads, 0 decodes on the calling thread. Its global
+// pool is only sized here if nobody did before (it starts with 0 threads), a
+// pool set up by the application is left alone
+int exrThreadCount() {
+  std::call_once(g_exr_thread_pool_flag, []() {
+    int count = GetImageIOThreadCount();
+    if (Imf::globalThreadCount() == 0) {
+      Imf::setGlobalThreadCount(count > 1 ? count : 0);
+    }
+  });
+  int count = GetImageIOThreadCount();
+  return count > 1 ? count : 0;
+}
+
+// arena of the pixel conversions, replaced when the io thread count changes,
+// a read or write still running in the old one keeps it alive
+struct IoArena {
+  int threads;
+  tbb::task_arena arena;
+
+  explicit IoArena(int threads) : threads(threads), arena(threads) {}
+};
+
+std::mutex g_io_arena_mutex;
+std::shared_ptr<IoArena> g_io_arena;
+
+std::shared_ptr<IoArena> ioArena(int threads) {
+  std::lock_guard<std::mutex> lock(g_io_arena_mutex);
+  if (!g_io_arena || g_io_arena->threads != threads) {
+    g_io_arena = std::make_shared<IoArena>(threads);
+  }
+  return g_io_arena;
+}
+
+// run func(begin, end) over row bands of [0, rows) with the io thread count
+template <typename Func> void parallelRows(int rows, Func &&func) {
+  int count = GetImageIOThreadCount();
+  if (count <= 1 || rows <= 1) {
+    func(0, rows);
+    return;
+  }
+  std::shared_ptr<IoArena> io = ioArena(count);
+  io->arena.execute([&]() {
+    ParallelFor(0, rows, std::max(1, rows / (4 * count)), func);
+  });
+}
+} // namespace
+
+void SetImageIOThreadCount(int count) {
+  count = resolveThreadCount(count);
+  g_io_thread_count = count;
+  // make sure the lazy initialization will not override this value
+  std::call_once(g_exr_thread_pool_flag, []() {});
+  Imf::setGlobalThreadCount(count > 1 ? count : 0);
+}
+
+int GetImageIOThreadCount() {
+  int count = g_io_thread_count;
+  return count > 0 ? count : resolveThreadCount(0);
+}
+
+void SetImageIOMemoryMapping(bool enable) { g_io_memory_mapping = enable; }
+
+bool GetImageIOMemoryMapping() { return g_io_memory_mapping; }
+
+void PrefetchImageFile(const std::filesystem::path &input) {
+  PrefetchFile(input);
+}
+
+void ReadPngBuffer(const std::filesystem::path &input, ImageBuffer4u8 *output) {
   DEBUG("read png file: {}", input);
   int height, width, channels;
-  std::unique_ptr<uint8_t, std::function<void(void *)>> data_handle(
-      stbi_load(input.u8string().c_str(), &width, &height, &channels, 4),
-      [](void *d) { stbi_image_free(d); });
-  if (!data_handle) {
+  uint8_t *data = nullptr;
+  if (GetImageIOMemoryMapping()) {
+    MappedFile file(input);
+    file.Advise(MappedFile::AccessHint::Sequential);
+    if (file.Size() <= static_cast<size_t>(INT_MAX)) {
+      data = stbi_load_from_memory(
+          reinterpret_cast<const stbi_uc *>(file.Data()),
+          static_cast<int>(file.Size()), &width, &height, &channels, 4);
+    }
+  } else {
+    data = stbi_load(input.u8string().c_str(), &width, &height, &channels, 4);
+  }
+  if (!data) {
     throw RuntimeError("failed to read png: {}", input);
   }
+  ImageBuffer4u8 buffer(reinterpret_cast<Color4u8 *>(data), height, width,
+                        [](void *d) { stbi_image_free(d); });
+  if (output) {
+    *output = std::move(buffer);
+  }
+}
+
+void ReadPng(const std::filesystem::path &input, ImageData4u8 *output) {
+  ImageBuffer4u8 buffer;
+  ReadPngBuffer(input, &buffer);
   if (!output) {
     return;
   }
-  *output = ImageDataView4u8(
-      reinterpret_cast<ImageDataView4u8::PointerArgType>(data_handle.get()),
-      height, width);
+  *output = buffer.View();
 }
 
 // ImageData4f readExr(const std::filesystem::path &input) {
@@ -44,75 +166,750 @@ void ReadPng(const std::filesystem::path &input, ImageData4u8 *output) {
 //   return res;
 // }
 
-template <typename T>
+namespace {
+// Imf::IStream over a MappedFile, OpenEXR reads the line buffers straight
+// from the mapping through readMemoryMapped
+class MappedIStream : public Imf::IStream {
+public:
+  explicit MappedIStream(const std::filesystem::path &input)
+      : Imf::IStream(input.u8string().c_str()), m_file(input) {
+    m_file.Advise(MappedFile::AccessHint::Sequential);
+  }
+
+  bool isMemoryMapped() const override { return true; }
+
+  bool read(char c[], int n) override {
+    std::copy_n(take(n), n, c);
+    return m_pos < m_file.Size();
+  }
+
+  char *readMemoryMapped(int n) override {
+    return const_cast<char *>(take(n));
+  }
+
+  uint64_t tellg() override { return m_pos; }
+
+  void seekg(uint64_t pos) override { m_pos = pos; }
+
+private:
+  const char *take(int n) {
+    if (n < 0 || m_pos + n > m_file.Size()) {
+      throw Iex::InputExc("unexpected end of file");
+    }
+    const char *data = m_file.Data() + m_pos;
+    m_pos += n;
+    return data;
+  }
+
+  MappedFile m_file;
+  uint64_t m_pos{};
+};
+
+// an exr input file (Imf::RgbaInputFile, Imf::TiledRgbaInputFile or
+// Imf::MultiPartInputFile), read
+// through a MappedIStream when memory mapping is on
+template <typename File> struct ExrInput {
+  std::unique_ptr<MappedIStream> stream;
+  std::unique_ptr<File> file;
+
+  explicit ExrInput(const std::filesystem::path &input)
+      : ExrInput(input, GetImageIOMemoryMapping()
+                            ? std::make_unique<MappedIStream>(input)
+                            : nullptr) {}
+
+  // continues on a stream that is already open, null without memory mapping
+  ExrInput(const std::filesystem::path &input,
+           std::unique_ptr<MappedIStream> opened)
+      : stream(std::move(opened)) {
+    if (stream) {
+      file = std::make_unique<File>(*stream, exrThreadCount());
+    } else {
+      file = std::make_unique<File>(input.u8string().c_str(), exrThreadCount());
+    }
+  }
+};
+
+// scanlines decoded per chunk and per thread, a multiple of the line buffer
+// size of every OpenEXR compressor (1, 16 or 32) but DWAB (256), whose chunks
+// are rounded up to whole line buffers
+constexpr int EXR_CHUNK_LINES = 32;
+
+// enough line buffers in flight for every OpenEXR worker thread
+int exrChunkLines() {
+  return EXR_CHUNK_LINES * std::max(1, exrThreadCount());
+}
+
+// scanlines OpenEXR compresses together, see numLinesInBuffer in ImfCompressor
+int exrLinesInBuffer(Imf::Compression compression) {
+  switch (compression) {
+  case Imf::ZIP_COMPRESSION:
+  case Imf::PXR24_COMPRESSION:
+    return 16;
+  case Imf::PIZ_COMPRESSION:
+  case Imf::B44_COMPRESSION:
+  case Imf::B44A_COMPRESSION:
+  case Imf::DWAA_COMPRESSION:
+    return 32;
+  case Imf::DWAB_COMPRESSION:
+    return 256;
+  default:
+    return 1;
+  }
+}
+
+void checkExrSize(const std::filesystem::path &input, const Imath::Box2i &dw,
+                  Eigen::Index rows, Eigen::Index cols) {
+  int width = dw.max.x - dw.min.x + 1;
+  int height = dw.max.y - dw.min.y + 1;
+  if (rows != height || cols != width) {
+    throw RuntimeError("exr size mismatch: {}, file(hxw): {}x{}, view(hxw): "
+                       "{}x{}",
+                       input, height, width, rows, cols);
+  }
+}
+
+// decode the rows of `roi` chunk by chunk into a small full width scratch
+// buffer, func(row, src, src_stride, lines) receives the first row of the
+// chunk (relative to the roi) and the roi part of the chunk. Chunks end on
+// line buffer boundaries of the file, so that a roi starting inside a line
+// buffer does not decode that buffer twice
+template <typename Func>
+void readExrRegion(Imf::RgbaInputFile &file, const Imath::Box2i &roi,
+                   Func &&func) {
+  Imath::Box2i dw = file.dataWindow();
+  int file_width = dw.max.x - dw.min.x + 1;
+  int height = roi.max.y - roi.min.y + 1;
+  int buffer_lines = exrLinesInBuffer(file.header().compression());
+  int chunk_lines =
+      (exrChunkLines() + buffer_lines - 1) / buffer_lines * buffer_lines;
+  PooledBuffer<Imf::Rgba> chunk(
+      static_cast<size_t>(std::min(chunk_lines, height)) * file_width);
+  for (int row = 0; row < height;) {
+    int y = roi.min.y + row;
+    int chunk_end = dw.min.y + ((y - dw.min.y) / chunk_lines + 1) * chunk_lines;
+    int lines = std::min(chunk_end - y, height - row);
+    file.setFrameBuffer(chunk.Data() - dw.min.x - y * file_width, 1,
+                        file_width);
+    file.readPixels(y, y + lines - 1);
+    func(row, chunk.Data() + (roi.min.x - dw.min.x),
+         static_cast<std::ptrdiff_t>(file_width), lines);
+    row += lines;
+  }
+}
+
+// the same for tiled files, only the tiles overlapping `roi` are decoded, a
+// band of whole tile rows at a time
+template <typename Func>
+void readExrRegion(Imf::TiledRgbaInputFile &file, const Imath::Box2i &roi,
+                   Func &&func) {
+  Imath::Box2i dw = file.dataWindow();
+  int tile_width = static_cast<int>(file.tileXSize());
+  int tile_height = static_cast<int>(file.tileYSize());
+  int dx_min = (roi.min.x - dw.min.x) / tile_width;
+  int dx_max = (roi.max.x - dw.min.x) / tile_width;
+  int dy_min = (roi.min.y - dw.min.y) / tile_height;
+  int dy_max = (roi.max.y - dw.min.y) / tile_height;
+  int tile_rows = std::max(1, exrChunkLines() / tile_height);
+  int x0 = dw.min.x + dx_min * tile_width;
+  int band_width = (dx_max - dx_min + 1) * tile_width;
+  PooledBuffer<Imf::Rgba> band(static_cast<size_t>(tile_rows) * tile_height *
+                               band_width);
+  for (int dy = dy_min; dy <= dy_max; dy += tile_rows) {
+    int dy_last = std::min(dy_max, dy + tile_rows - 1);
+    int y0 = dw.min.y + dy * tile_height;
+    file.setFrameBuffer(band.Data() - x0 - y0 * band_width, 1, band_width);
+    file.readTiles(dx_min, dx_max, dy, dy_last);
+    int first = std::max(y0, roi.min.y);
+    int last = std::min(dw.min.y + (dy_last + 1) * tile_height - 1, roi.max.y);
+    func(first - roi.min.y,
+         band.Data() + static_cast<std::ptrdiff_t>(first - y0) * band_width +
+             (roi.min.x - x0),
+         static_cast<std::ptrdiff_t>(band_width), last - first + 1);
+  }
+}
+
+// convert `lines` rows of `width` half pixels with the PixelFormat kernels
+template <typename Pixel>
+void convertExrRows(const Imf::Rgba *src, std::ptrdiff_t src_stride,
+                    Pixel *dst, std::ptrdiff_t dst_stride, int lines,
+                    int width) {
+  parallelRows(lines, [&](int begin, int end) {
+    for (int r = begin; r < end; ++r) {
+      PixelFormat<Pixel>::FromRgba(src + r * src_stride, dst + r * dst_stride,
+                                   width);
+    }
+  });
+}
+
+// decode chunk by chunk into scratch and convert, the overloads below decode
+// in place
+template <typename Pixel>
+void readExrPixels(Imf::RgbaInputFile &file, ImageDataView<Pixel> output) {
+  std::ptrdiff_t width = output.cols();
+  readExrRegion(file, file.dataWindow(),
+                [&output, width](int row, const Imf::Rgba *src,
+                                 std::ptrdiff_t src_stride, int lines) {
+                  convertExrRows(src, src_stride, output.data() + row * width,
+                                 width, lines, static_cast<int>(width));
+                });
+}
+
+void readExrPixels(Imf::RgbaInputFile &file, ImageDataView4h output) {
+  Imath::Box2i dw = file.dataWindow();
+  int width = dw.max.x - dw.min.x + 1;
+  file.setFrameBuffer(output.data() - dw.min.x - dw.min.y * width, 1, width);
+  file.readPixels(dw.min.y, dw.max.y);
+}
+
+void readExrPixels(Imf::RgbaInputFile &file, ImageDataView<Color4h> output) {
+  readExrPixels(file,
+                ImageDataView4h(reinterpret_cast<Imf::Rgba *>(output.data()),
+                                output.rows(), output.cols()));
+}
+
+// a Color4f row is twice as wide as an Imf::Rgba row, so each chunk is decoded
+// into the back half of its own destination rows and widened front to back,
+// pixel i is always read before the write of pixel i can reach it
+void readExrPixels(Imf::RgbaInputFile &file, ImageDataView4f output) {
+  static_assert(sizeof(Color4f) == 2 * sizeof(Imf::Rgba));
+  Imath::Box2i dw = file.dataWindow();
+  int width = dw.max.x - dw.min.x + 1;
+  int height = dw.max.y - dw.min.y + 1;
+  int chunk_lines = exrChunkLines();
+  auto *base = reinterpret_cast<Imf::Rgba *>(output.data());
+  std::ptrdiff_t y_stride = 2 * static_cast<std::ptrdiff_t>(width);
+  file.setFrameBuffer(base + width - dw.min.x - dw.min.y * y_stride, 1,
+                      y_stride);
+  for (int row = 0; row < height; row += chunk_lines) {
+    int lines = std::min(chunk_lines, height - row);
+    int y = dw.min.y + row;
+    file.readPixels(y, y + lines - 1);
+    parallelRows(lines, [&](int begin, int end) {
+      for (int r = row + begin; r < row + end; ++r) {
+        HalfToFloat(base + r * y_stride + width,
+                    output.data() + static_cast<std::ptrdiff_t>(r) * width,
+                    width);
+      }
+    });
+  }
+}
+
+// convert and write `pic` chunk by chunk, `dw` is the data window of the file
+template <typename Pixel>
+void writeExrPixels(Imf::RgbaOutputFile &file, const Imath::Box2i &dw,
+                    const ImageData<Pixel> &pic) {
+  int width = static_cast<int>(pic.cols());
+  int height = static_cast<int>(pic.rows());
+  int chunk_lines = exrChunkLines();
+  PooledBuffer<Imf::Rgba> chunk(
+      static_cast<size_t>(std::min(chunk_lines, height)) * width);
+  for (int row = 0; row < height; row += chunk_lines) {
+    int lines = std::min(chunk_lines, height - row);
+    parallelRows(lines, [&](int begin, int end) {
+      PixelFormat<Pixel>::ToRgba(
+          pic.data() + static_cast<std::ptrdiff_t>(row + begin) * width,
+          chunk.Data() + static_cast<std::ptrdiff_t>(begin) * width,
+          static_cast<size_t>(end - begin) * width);
+    });
+    int y = dw.min.y + row;
+    file.setFrameBuffer(chunk.Data() - dw.min.x - y * width, 1, width);
+    file.writePixels(lines);
+  }
+}
+
+Imf::Header exrHeader(const Imath::Box2i &display_window,
+                      const Imath::Box2i &data_window,
+                      const ExrSettings &settings) {
+  Imf::Header header(display_window, data_window, 1, Imath::V2f(0, 0), 1,
+                     Imf::INCREASING_Y,
+                     static_cast<Imf::Compression>(settings.compression));
+  header.dwaCompressionLevel() = settings.dwa_level;
+  return header;
+}
+} // namespace
+
+void ReadExrSize(const std::filesystem::path &input, int *height, int *width) {
+  ExrInput<Imf::RgbaInputFile> exr(input);
+  Imf::RgbaInputFile &file = *exr.file;
+  Imath::Box2i dw = file.dataWindow();
+  if (height) {
+    *height = dw.max.y - dw.min.y + 1;
+  }
+  if (width) {
+    *width = dw.max.x - dw.min.x + 1;
+  }
+}
+
+void ReadExr(const std::filesystem::path &input, ImageDataView4h output) {
+  DEBUG("read exr file (view): {}", input);
+  ExrInput<Imf::RgbaInputFile> exr(input);
+  Imf::RgbaInputFile &file = *exr.file;
+  checkExrSize(input, file.dataWindow(), output.rows(), output.cols());
+  readExrPixels(file, output);
+}
+
+void ReadExr(const std::filesystem::path &input, ImageDataView4f output) {
+  DEBUG("read exr file (view): {}", input);
+  ExrInput<Imf::RgbaInputFile> exr(input);
+  Imf::RgbaInputFile &file = *exr.file;
+  checkExrSize(input, file.dataWindow(), output.rows(), output.cols());
+  readExrPixels(file, output);
+}
+
+template <typename T, typename>
 void ReadExr(const std::filesystem::path &input, T *output) {
   DEBUG("read exr file: {}", input);
-  Imf::RgbaInputFile file(input.u8string().c_str());
+  ExrInput<Imf::RgbaInputFile> exr(input);
+  Imf::RgbaInputFile &file = *exr.file;
   // support for Cropped image reading and writing
   Imath::Box2i dw = file.dataWindow();
   int width = dw.max.x - dw.min.x + 1;
   int height = dw.max.y - dw.min.y + 1;
-  ImageData4h pixels(height, width);
-  file.setFrameBuffer(pixels.data() - dw.min.x - dw.min.y * width, 1, width);
-  file.readPixels(dw.min.y, dw.max.y);
   if (!output) {
+    // still decode everything so that a broken file is reported
+    readExrRegion(file, dw, [](int, const Imf::Rgba *, std::ptrdiff_t, int) {});
     return;
   }
-  if constexpr (std::is_same_v<T, ImageData4h>) {
-    *output = std::move(pixels);
-  } else if constexpr (std::is_same_v<T, ImageData4f>) {
-    *output = pixels.unaryExpr([](const Imf::Rgba &c) { return ToColor4f(c); });
-  } else if constexpr (std::is_same_v<T, ImageData4u8>) {
-    *output = pixels.unaryExpr(
-        [](const Imf::Rgba &c) { return ToUint8(ToSrgb(ToColor4f(c))); });
+  output->resize(height, width);
+  readExrPixels(file, ImageDataView<typename T::Scalar>(output->data(), height,
+                                                         width));
+}
+
+template <typename T, typename>
+void ReadExrRegion(const std::filesystem::path &input, int row_offset,
+                   int col_offset, int height, int width, T *output) {
+  DEBUG("read exr file (region): {}, rows [{}, {}), cols [{}, {})", input,
+        row_offset, row_offset + height, col_offset, col_offset + width);
+  std::unique_ptr<MappedIStream> stream;
+  if (GetImageIOMemoryMapping()) {
+    stream = std::make_unique<MappedIStream>(input);
+  }
+  // a scanline read of a tiled file decodes whole tile rows, the version
+  // field tells which reader to open the file with, it is opened once
+  bool tiled = false;
+  bool valid = stream ? Imf::isOpenExrFile(*stream, tiled)
+                      : Imf::isOpenExrFile(input.u8string().c_str(), tiled);
+  if (!valid) {
+    throw RuntimeError("failed to read exr: {}, not an exr file", input);
+  }
+  Imath::Box2i roi{{col_offset, row_offset},
+                   {col_offset + width - 1, row_offset + height - 1}};
+  auto read = [&](auto &file) {
+    Imath::Box2i dw = file.dataWindow();
+    if (height <= 0 || width <= 0 || roi.min.x < dw.min.x ||
+        roi.min.y < dw.min.y || roi.max.x > dw.max.x || roi.max.y > dw.max.y) {
+      throw RuntimeError(
+          "exr region out of the data window: {}, rows [{}, {}), cols [{}, "
+          "{}), data window rows [{}, {}], cols [{}, {}]",
+          input, row_offset, row_offset + height, col_offset,
+          col_offset + width, dw.min.y, dw.max.y, dw.min.x, dw.max.x);
+    }
+    T scratch;
+    T *result = output ? output : &scratch;
+    result->resize(height, width);
+    readExrRegion(file, roi,
+                  [result, width](int row, const Imf::Rgba *src,
+                                  std::ptrdiff_t src_stride, int lines) {
+                    convertExrRows(src, src_stride,
+                                   result->data() +
+                                       static_cast<std::ptrdiff_t>(row) * width,
+                                   width, lines, width);
+                  });
+  };
+  if (tiled) {
+    ExrInput<Imf::TiledRgbaInputFile> exr(input, std::move(stream));
+    read(*exr.file);
+  } else {
+    ExrInput<Imf::RgbaInputFile> exr(input, std::move(stream));
+    read(*exr.file);
   }
 }
 
+namespace {
+// uncompressed bytes per independently deflated band, the band layout does
+// not depend on the thread count so the output is deterministic
+constexpr size_t PNG_BAND_BYTES = 1024 * 1024;
+constexpr size_t PNG_BYTES_PER_PIXEL = 4;
+
+uint8_t paeth(uint8_t a, uint8_t b, uint8_t c) {
+  int p = static_cast<int>(a) + b - c;
+  int pa = std::abs(p - a);
+  int pb = std::abs(p - b);
+  int pc = std::abs(p - c);
+  if (pa <= pb && pa <= pc) {
+    return a;
+  }
+  return pb <= pc ? b : c;
+}
+
+// out[0] is the filter type, followed by the filtered bytes, `prev` is null for
+// the first row. Adaptive tries each filter in `scratch` (n + 1 bytes, unused
+// by the other filters)
+void filterPngRow(PngFilter filter, const uint8_t *row, const uint8_t *prev,
+                  size_t n, uint8_t *out, uint8_t *scratch = nullptr) {
+  constexpr size_t bpp = PNG_BYTES_PER_PIXEL;
+  auto up = [prev](size_t i) -> uint8_t { return prev ? prev[i] : 0; };
+  auto left = [row](size_t i) -> uint8_t { return i >= bpp ? row[i - bpp] : 0; };
+  auto up_left = [prev](size_t i) -> uint8_t {
+    return prev && i >= bpp ? prev[i - bpp] : 0;
+  };
+  out[0] = static_cast<uint8_t>(filter);
+  uint8_t *dst = out + 1;
+  switch (filter) {
+  case PngFilter::None:
+    std::copy(row, row + n, dst);
+    break;
+  case PngFilter::Sub:
+    for (size_t i = 0; i < n; ++i) {
+      dst[i] = row[i] - left(i);
+    }
+    break;
+  case PngFilter::Up:
+    for (size_t i = 0; i < n; ++i) {
+      dst[i] = row[i] - up(i);
+    }
+    break;
+  case PngFilter::Average:
+    for (size_t i = 0; i < n; ++i) {
+      dst[i] = row[i] - static_cast<uint8_t>((left(i) + up(i)) / 2);
+    }
+    break;
+  case PngFilter::Paeth:
+    for (size_t i = 0; i < n; ++i) {
+      dst[i] = row[i] - paeth(left(i), up(i), up_left(i));
+    }
+    break;
+  case PngFilter::Adaptive: {
+    // the same heuristic as libpng: bytes are taken as signed and the filter
+    // with the smallest sum of magnitudes wins
+    uint64_t best_sum = UINT64_MAX;
+    for (PngFilter f : {PngFilter::None, PngFilter::Sub, PngFilter::Up,
+                        PngFilter::Average, PngFilter::Paeth}) {
+      filterPngRow(f, row, prev, n, scratch);
+      uint64_t sum = 0;
+      for (size_t i = 1; i <= n; ++i) {
+        sum += std::abs(static_cast<int8_t>(scratch[i]));
+      }
+      if (sum < best_sum) {
+        best_sum = sum;
+        std::copy(scratch, scratch + n + 1, out);
+      }
+    }
+    break;
+  }
+  }
+}
+
+struct PngBand {
+  std::vector<uint8_t> data;
+  uLong adler{};
+  size_t length{};
+};
+
+// filter and deflate rows [begin, end) as a raw deflate stream, every band but
+// the last one ends with a sync flush so that the streams can be concatenated
+PngBand deflatePngBand(const ImageData4u8 &pic, int begin, int end,
+                       const PngSettings &settings, bool last) {
+  size_t row_bytes = static_cast<size_t>(pic.cols()) * PNG_BYTES_PER_PIXEL;
+  const auto *pixels = reinterpret_cast<const uint8_t *>(pic.data());
+  PooledBuffer<uint8_t> filtered((row_bytes + 1) * (end - begin));
+  std::vector<uint8_t> scratch(
+      settings.filter == PngFilter::Adaptive ? row_bytes + 1 : 0);
+  for (int r = begin; r < end; ++r) {
+    const uint8_t *row = pixels + r * row_bytes;
+    filterPngRow(settings.filter, row, r > 0 ? row - row_bytes : nullptr,
+                 row_bytes, filtered.Data() + (r - begin) * (row_bytes + 1),
+                 scratch.data());
+  }
+
+  PngBand band;
+  band.length = filtered.Size();
+  band.adler = adler32(adler32(0L, Z_NULL, 0), filtered.Data(),
+                       static_cast<uInt>(filtered.Size()));
+  z_stream stream{};
+  if (deflateInit2(&stream, Clamp(settings.compression_level, 0, 9),
+                   Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+    throw RuntimeError("failed to initialize deflate");
+  }
+  // room for the sync flush marker
+  band.data.resize(deflateBound(&stream, static_cast<uLong>(filtered.Size())) +
+                   16);
+  stream.next_in = filtered.Data();
+  stream.avail_in = static_cast<uInt>(filtered.Size());
+  stream.next_out = band.data.data();
+  stream.avail_out = static_cast<uInt>(band.data.size());
+  int ret = deflate(&stream, last ? Z_FINISH : Z_SYNC_FLUSH);
+  bool ok = last ? ret == Z_STREAM_END : ret == Z_OK && stream.avail_in == 0;
+  band.data.resize(stream.total_out);
+  deflateEnd(&stream);
+  if (!ok) {
+    throw RuntimeError("failed to deflate png rows [{}, {})", begin, end);
+  }
+  return band;
+}
+
+void appendBigEndian(std::vector<uint8_t> &out, uint32_t value) {
+  for (int shift = 24; shift >= 0; shift -= 8) {
+    out.push_back(static_cast<uint8_t>(value >> shift));
+  }
+}
+
+void writePngChunk(std::ofstream &file, const char *type,
+                   const uint8_t *data, size_t size) {
+  std::vector<uint8_t> header;
+  appendBigEndian(header, static_cast<uint32_t>(size));
+  header.insert(header.end(), type, type + 4);
+  uLong crc = crc32(0L, Z_NULL, 0);
+  crc = crc32(crc, header.data() + 4, 4);
+  if (size > 0) {
+    crc = crc32(crc, data, static_cast<uInt>(size));
+  }
+  std::vector<uint8_t> footer;
+  appendBigEndian(footer, static_cast<uint32_t>(crc));
+  file.write(reinterpret_cast<const char *>(header.data()), header.size());
+  file.write(reinterpret_cast<const char *>(data), size);
+  file.write(reinterpret_cast<const char *>(footer.data()), footer.size());
+}
+} // namespace
+
 void SavePng(const std::filesystem::path &output, const ImageData4u8 &pic) {
+  SavePng(output, pic, PngSettings{});
+}
+
+void SavePng(const std::filesystem::path &output, const ImageData4u8 &pic,
+             const PngSettings &settings) {
   DEBUG("save png file: {}", output);
-  auto u8 = output.u8string();
-  auto p = std::filesystem::u8path(u8);
-  int success =
-      stbi_write_png(output.u8string().c_str(), pic.cols(), pic.rows(), 4, pic.data(), 0);
-  if (!success) {
+  int height = static_cast<int>(pic.rows());
+  int width = static_cast<int>(pic.cols());
+  if (height == 0 || width == 0) {
+    throw RuntimeError("failed to save png: {}, empty image", output);
+  }
+  size_t row_bytes = static_cast<size_t>(width) * PNG_BYTES_PER_PIXEL;
+  int band_rows = static_cast<int>(
+      std::clamp<size_t>(PNG_BAND_BYTES / row_bytes, 1, height));
+  int num_bands = (height + band_rows - 1) / band_rows;
+  std::vector<PngBand> bands(num_bands);
+  parallelRows(num_bands, [&](int begin, int end) {
+    for (int b = begin; b < end; ++b) {
+      int row = b * band_rows;
+      bands[b] = deflatePngBand(pic, row, std::min(height, row + band_rows),
+                                settings, b == num_bands - 1);
+    }
+  });
+
+  // zlib header + concatenated deflate streams + adler32 of the whole data
+  uLong adler = adler32(0L, Z_NULL, 0);
+  for (const auto &band : bands) {
+    adler = adler32_combine(adler, band.adler, static_cast<z_off_t>(band.length));
+  }
+  bands.front().data.insert(bands.front().data.begin(), {0x78, 0x9c});
+  appendBigEndian(bands.back().data, static_cast<uint32_t>(adler));
+
+  std::ofstream file(output, std::ios::binary);
+  if (!file) {
+    throw RuntimeError("failed to save png: {}", output);
+  }
+  static const uint8_t signature[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+  file.write(reinterpret_cast<const char *>(signature), sizeof(signature));
+  std::vector<uint8_t> ihdr;
+  appendBigEndian(ihdr, static_cast<uint32_t>(width));
+  appendBigEndian(ihdr, static_cast<uint32_t>(height));
+  // 8 bit rgba, deflate, adaptive filtering, no interlace
+  ihdr.insert(ihdr.end(), {8, 6, 0, 0, 0});
+  writePngChunk(file, "IHDR", ihdr.data(), ihdr.size());
+  for (const auto &band : bands) {
+    writePngChunk(file, "IDAT", band.data.data(), band.data.size());
+  }
+  writePngChunk(file, "IEND", nullptr, 0);
+  if (!file) {
     throw RuntimeError("failed to save png: {}", output);
   }
 }
 
 void SaveExr(const std::filesystem::path &output, const ImageData4f &pic) {
-  DEBUG("save exr file: {}", output);
-  ImageData4h pic_4h =
-      pic.unaryExpr([](const Color4f &c) { return ToImfRgba(c); });
-  Imf::RgbaOutputFile file(output.u8string().c_str(), pic.cols(), pic.rows(),
-                           Imf::WRITE_RGBA);
-  file.setFrameBuffer(pic_4h.data(), 1, pic_4h.cols());
-  file.writePixels(pic_4h.rows());
+  SaveExr(output, pic, ExrSettings{});
 }
 
 void SaveExr(const std::filesystem::path &output, int display_height,
              int display_width, int row_offset, int col_offset,
              const ImageData4f &block) {
+  SaveExr(output, display_height, display_width, row_offset, col_offset, block,
+          ExrSettings{});
+}
+
+void SaveExr(const std::filesystem::path &output, const ImageData4f &pic,
+             const ExrSettings &settings) {
+  SaveExr<Color4f>(output, pic, settings);
+}
+
+void SaveExr(const std::filesystem::path &output, int display_height,
+             int display_width, int row_offset, int col_offset,
+             const ImageData4f &block, const ExrSettings &settings) {
+  SaveExr<Color4f>(output, display_height, display_width, row_offset,
+                   col_offset, block, settings);
+}
+
+template <typename Pixel, typename>
+void SaveExr(const std::filesystem::path &output, const ImageData<Pixel> &pic,
+             const ExrSettings &settings) {
+  DEBUG("save exr file: {}", output);
+  Imath::Box2i data_window{
+      {0, 0}, {static_cast<int>(pic.cols()) - 1, static_cast<int>(pic.rows()) - 1}};
+  Imf::RgbaOutputFile file(output.u8string().c_str(),
+                           exrHeader(data_window, data_window, settings),
+                           Imf::WRITE_RGBA, exrThreadCount());
+  writeExrPixels(file, data_window, pic);
+}
+
+template <typename Pixel, typename>
+void SaveExr(const std::filesystem::path &output, int display_height,
+             int display_width, int row_offset, int col_offset,
+             const ImageData<Pixel> &block, const ExrSettings &settings) {
   DEBUG("save exr file (sub): {}", output);
-  lumos::ImageData4h block_data =
-      block.unaryExpr([](const Color4f &c) { return lumos::ToImfRgba(c); });
   int dw_width = block.cols();
   int dw_height = block.rows();
   Imath::Box2i display_window{{0, 0}, {display_width - 1, display_height - 1}};
   Imath::Box2i data_window{
       {col_offset, row_offset},
       {col_offset + dw_width - 1, row_offset + dw_height - 1}};
-  Imf::RgbaOutputFile file(output.u8string().c_str(), display_window, data_window,
-                           Imf::WRITE_RGBA);
-  file.setFrameBuffer(block_data.data() - data_window.min.x -
-                          data_window.min.y * dw_width,
-                      1, dw_width);
-  file.writePixels(dw_height);
-}
-
-template void ReadExr<ImageData4h>(const std::filesystem::path &,
-                                   ImageData4h *);
-template void ReadExr<ImageData4f>(const std::filesystem::path &,
-                                   ImageData4f *);
-template void ReadExr<ImageData4u8>(const std::filesystem::path &,
-                                    ImageData4u8 *);
+  Imf::RgbaOutputFile file(output.u8string().c_str(),
+                           exrHeader(display_window, data_window, settings),
+                           Imf::WRITE_RGBA, exrThreadCount());
+  writeExrPixels(file, data_window, block);
+}
+
+void SaveExrLayers(const std::filesystem::path &output, int height, int width,
+                   const std::vector<ExrLayer> &layers) {
+  DEBUG("save exr file (layers): {}, layers: {}", output, layers.size());
+  if (height <= 0 || width <= 0 || layers.empty()) {
+    throw RuntimeError("invalid exr layers: {}, size: {}x{}, layers: {}",
+                       output, height, width, layers.size());
+  }
+  Imath::Box2i window{{0, 0}, {width - 1, height - 1}};
+  std::vector<Imf::Header> headers;
+  headers.reserve(layers.size());
+  for (const ExrLayer &layer : layers) {
+    bool duplicate =
+        std::count_if(layers.begin(), layers.end(), [&](const ExrLayer &other) {
+          return other.name == layer.name;
+        }) > 1;
+    if (layer.name.empty() || duplicate || layer.channels.empty() ||
+        !layer.data) {
+      throw RuntimeError("invalid exr layer: {}, layer: '{}', channels: {}",
+                         output, layer.name, layer.channels.size());
+    }
+    Imf::Header header = exrHeader(window, window, layer.settings);
+    header.setName(layer.name);
+    header.setType(Imf::SCANLINEIMAGE);
+    for (const std::string &channel : layer.channels) {
+      header.channels().insert(
+          channel, Imf::Channel(static_cast<Imf::PixelType>(layer.type)));
+    }
+    headers.push_back(header);
+  }
+  Imf::MultiPartOutputFile file(output.u8string().c_str(), headers.data(),
+                                static_cast<int>(headers.size()), false,
+                                exrThreadCount());
+  for (size_t i = 0; i < layers.size(); ++i) {
+    const ExrLayer &layer = layers[i];
+    // float samples are narrowed to half by OpenEXR while compressing
+    Imf::PixelType type =
+        layer.type == ExrPixelType::Uint ? Imf::UINT : Imf::FLOAT;
+    size_t x_stride = sizeof(float) * layer.channels.size();
+    size_t y_stride = x_stride * width;
+    char *base = const_cast<char *>(static_cast<const char *>(layer.data));
+    Imf::FrameBuffer frame_buffer;
+    for (size_t c = 0; c < layer.channels.size(); ++c) {
+      frame_buffer.insert(layer.channels[c],
+                          Imf::Slice(type, base + c * sizeof(float), x_stride,
+                                     y_stride));
+    }
+    Imf::OutputPart part(file, static_cast<int>(i));
+    part.setFrameBuffer(frame_buffer);
+    part.writePixels(height);
+  }
+}
+
+void ReadExrLayerInfo(const std::filesystem::path &input,
+                      std::vector<ExrLayerInfo> *layers) {
+  ExrInput<Imf::MultiPartInputFile> exr(input);
+  layers->clear();
+  for (int i = 0; i < exr.file->parts(); ++i) {
+    const Imf::Header &header = exr.file->header(i);
+    ExrLayerInfo info;
+    if (header.hasName()) {
+      info.name = header.name();
+    }
+    for (auto it = header.channels().begin(); it != header.channels().end();
+         ++it) {
+      info.channels.emplace_back(it.name());
+    }
+    const Imath::Box2i &dw = header.dataWindow();
+    info.height = dw.max.y - dw.min.y + 1;
+    info.width = dw.max.x - dw.min.x + 1;
+    info.compression = static_cast<ExrCompression>(header.compression());
+    layers->push_back(std::move(info));
+  }
+}
+
+void ReadExrChannels(const std::filesystem::path &input,
+                     const std::string &layer,
+                     const std::vector<std::string> &channels, int *height,
+                     int *width, std::vector<float> *output) {
+  DEBUG("read exr file (channels): {}, layer: '{}', channels: {}", input,
+        layer, channels.size());
+  ExrInput<Imf::MultiPartInputFile> exr(input);
+  int part_index = -1;
+  for (int i = 0; i < exr.file->parts() && part_index < 0; ++i) {
+    const Imf::Header &header = exr.file->header(i);
+    if ((header.hasName() ? header.name() : std::string()) == layer) {
+      part_index = i;
+    }
+  }
+  if (part_index < 0) {
+    throw RuntimeError("exr layer not found: {}, layer: '{}'", input, layer);
+  }
+  Imf::InputPart part(*exr.file, part_index);
+  const Imf::Header &header = part.header();
+  for (const std::string &channel : channels) {
+    if (!header.channels().findChannel(channel)) {
+      throw RuntimeError("exr channel not found: {}, layer: '{}', channel: {}",
+                         input, layer, channel);
+    }
+  }
+  Imath::Box2i dw = header.dataWindow();
+  int w = dw.max.x - dw.min.x + 1;
+  int h = dw.max.y - dw.min.y + 1;
+  *height = h;
+  *width = w;
+  output->resize(static_cast<size_t>(h) * w * channels.size());
+  if (channels.empty()) {
+    return;
+  }
+  std::ptrdiff_t x_stride = sizeof(float) * channels.size();
+  std::ptrdiff_t y_stride = x_stride * w;
+  char *base = reinterpret_cast<char *>(output->data()) - dw.min.x * x_stride -
+               dw.min.y * y_stride;
+  Imf::FrameBuffer frame_buffer;
+  for (size_t c = 0; c < channels.size(); ++c) {
+    frame_buffer.insert(channels[c],
+                        Imf::Slice(Imf::FLOAT, base + c * sizeof(float),
+                                   x_stride, y_stride));
+  }
+  part.setFrameBuffer(frame_buffer);
+  part.readPixels(dw.min.y, dw.max.y);
+}
+
+#define LUMOS_INSTANTIATE_EXR_IO(Pixel)                                   \
+  template void ReadExr<ImageData<Pixel>>(const std::filesystem::path &,       \
+                                          ImageData<Pixel> *);                 \
+  template void ReadExrRegion<ImageData<Pixel>>(                               \
+      const std::filesystem::path &, int, int, int, int, ImageData<Pixel> *);  \
+  template void SaveExr<Pixel>(const std::filesystem::path &,                  \
+                               const ImageData<Pixel> &, const ExrSettings &); \
+  template void SaveExr<Pixel>(const std::filesystem::path &, int, int, int,   \
+                               int, const ImageData<Pixel> &,                  \
+                               const ExrSettings &);
+LUMOS_FOR_EACH_PIXEL_FORMAT(LUMOS_INSTANTIATE_EXR_IO)
+#undef LUMOS_INSTANTIATE_EXR_IO
 } // namespace lumos
\ No newline at end of file
@@ -0,0 +1,166 @@
+#include "lumos/core/mapped_file.h"
+#include "lumos/core/exception.h"
+
+#include <spdlog/fmt/ostr.h>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace lumos {
+#ifdef _WIN32
+MappedFile::MappedFile(const std::filesystem::path &path) : m_path(path) {
+  HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                            nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+                            nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    throw RuntimeError("failed to open file: {}", path);
+  }
+  m_file = file;
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size)) {
+    close();
+    throw RuntimeError("failed to get file size: {}", path);
+  }
+  m_size = static_cast<size_t>(size.QuadPart);
+  if (m_size == 0) {
+    return;
+  }
+  m_mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (!m_mapping) {
+    close();
+    throw RuntimeError("failed to map file: {}", path);
+  }
+  m_data = static_cast<const char *>(
+      MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+  if (!m_data) {
+    close();
+    throw RuntimeError("failed to map file: {}", path);
+  }
+}
+
+void MappedFile::Advise(AccessHint) const {}
+
+void MappedFile::close() {
+  if (m_data) {
+    UnmapViewOfFile(m_data);
+  }
+  if (m_mapping) {
+    CloseHandle(m_mapping);
+  }
+  if (m_file) {
+    CloseHandle(m_file);
+  }
+  m_data = nullptr;
+  m_mapping = nullptr;
+  m_file = nullptr;
+  m_size = 0;
+}
+#else
+MappedFile::MappedFile(const std::filesystem::path &path) : m_path(path) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw RuntimeError("failed to open file: {}", path);
+  }
+  struct stat st {};
+  if (fstat(fd, &st) != 0) {
+    ::close(fd);
+    throw RuntimeError("failed to get file size: {}", path);
+  }
+  m_size = static_cast<size_t>(st.st_size);
+  if (m_size > 0) {
+    void *data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      ::close(fd);
+      m_size = 0;
+      throw RuntimeError("failed to map file: {}", path);
+    }
+    m_data = static_cast<const char *>(data);
+  }
+  // the mapping keeps its own reference to the file
+  ::close(fd);
+}
+
+void MappedFile::Advise(AccessHint hint) const {
+  if (!m_data) {
+    return;
+  }
+  int advice = MADV_NORMAL;
+  switch (hint) {
+  case AccessHint::Normal:
+    advice = MADV_NORMAL;
+    break;
+  case AccessHint::Sequential:
+    advice = MADV_SEQUENTIAL;
+    break;
+  case AccessHint::Random:
+    advice = MADV_RANDOM;
+    break;
+  case AccessHint::WillNeed:
+    advice = MADV_WILLNEED;
+    break;
+  }
+  if (madvise(const_cast<char *>(m_data), m_size, advice) != 0) {
+    DEBUG("madvise failed on: {}", m_path);
+  }
+}
+
+void MappedFile::close() {
+  if (m_data) {
+    munmap(const_cast<char *>(m_data), m_size);
+  }
+  m_data = nullptr;
+  m_size = 0;
+}
+#endif
+
+MappedFile::MappedFile(MappedFile &&other) noexcept {
+  *this = std::move(other);
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+  if (this == &other) {
+    return *this;
+  }
+  close();
+  m_path = std::move(other.m_path);
+  m_data = other.m_data;
+  m_size = other.m_size;
+  other.m_data = nullptr;
+  other.m_size = 0;
+#ifdef _WIN32
+  m_file = other.m_file;
+  m_mapping = other.m_mapping;
+  other.m_file = nullptr;
+  other.m_mapping = nullptr;
+#endif
+  return *this;
+}
+
+MappedFile::~MappedFile() { close(); }
+
+void PrefetchFile(const std::filesystem::path &path) {
+#ifdef POSIX_FADV_WILLNEED
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw RuntimeError("failed to open file: {}", path);
+  }
+  // a length of 0 covers the whole file, the readahead runs in the background
+  if (posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED) != 0) {
+    DEBUG("posix_fadvise failed on: {}", path);
+  }
+  ::close(fd);
+#else
+  MappedFile file(path);
+  file.Advise(MappedFile::AccessHint::WillNeed);
+#endif
+}
+} // namespace lumos
@@ -0,0 +1,75 @@
+#include "lumos/core/mesh.h"
+#include "lumos/core/exception.h"
+#include "lumos/core/parallel.h"
+
+#include <mutex>
+
+namespace lumos {
+namespace {
+// vertices per task
+constexpr int MESH_GRAIN = 64 * 1024;
+} // namespace
+
+TriangleMesh::TriangleMesh(VertexBuffer vertices, IndexBuffer indices)
+    : m_vertices(std::move(vertices)), m_indices(std::move(indices)) {
+  if (m_vertices.cols() != 3 && m_vertices.cols() != 6) {
+    throw RuntimeError("vertex buffer needs 3 or 6 columns, got {}",
+                       m_vertices.cols());
+  }
+  uint32_t vertex_count = static_cast<uint32_t>(m_vertices.rows());
+  if (m_indices.size() > 0 && m_indices.maxCoeff() >= vertex_count) {
+    throw RuntimeError("vertex index {} out of range, {} vertices",
+                       m_indices.maxCoeff(), vertex_count);
+  }
+  std::mutex mutex;
+  ParallelFor(0, VertexCount(), MESH_GRAIN,
+              [&](int begin, int end) {
+                Bounds3f bounds;
+                for (int i = begin; i < end; ++i) {
+                  bounds.Extend(Position(static_cast<uint32_t>(i)));
+                }
+                std::lock_guard<std::mutex> lock(mutex);
+                m_bounds.Extend(bounds);
+              });
+  DEBUG("triangle mesh: {} vertices, {} triangles{}", VertexCount(),
+        TriangleCount(), HasNormals() ? ", normals" : "");
+}
+
+Bounds3f TriangleMesh::TriangleBounds(uint32_t triangle) const {
+  Vector3f p0, p1, p2;
+  TrianglePositions(triangle, &p0, &p1, &p2);
+  return {p0.cwiseMin(p1).cwiseMin(p2), p0.cwiseMax(p1).cwiseMax(p2)};
+}
+
+float TriangleMesh::SurfaceArea() const {
+  double area = 0.0;
+  for (uint32_t i = 0; i < static_cast<uint32_t>(TriangleCount()); ++i) {
+    Vector3f p0, p1, p2;
+    TrianglePositions(i, &p0, &p1, &p2);
+    area += 0.5 * (p1 - p0).cross(p2 - p0).norm();
+  }
+  return static_cast<float>(area);
+}
+
+Vector3f TriangleMesh::GeometricNormal(uint32_t triangle) const {
+  Vector3f p0, p1, p2;
+  TrianglePositions(triangle, &p0, &p1, &p2);
+  return (p1 - p0).cross(p2 - p0).normalized();
+}
+
+Vector3f TriangleMesh::ShadingNormal(uint32_t triangle, float u,
+                                     float v) const {
+  if (!HasNormals()) {
+    return GeometricNormal(triangle);
+  }
+  auto normal = [this, triangle](int corner) -> Vector3f {
+    const float *p = m_vertices.data() +
+                     static_cast<std::ptrdiff_t>(m_indices(triangle, corner)) *
+                         m_vertices.cols() +
+                     3;
+    return {p[0], p[1], p[2]};
+  };
+  return ((1.0f - u - v) * normal(0) + u * normal(1) + v * normal(2))
+      .normalized();
+}
+} // namespace lumos
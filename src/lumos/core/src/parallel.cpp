@@ -0,0 +1,58 @@
+#include "lumos/core/parallel.h"
+
+#include <atomic>
+#include <exception>
+#include <tbb/task_scheduler_observer.h>
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <pthread.h>
+#endif
+
+namespace lumos {
+namespace {
+thread_local std::string t_thread_name;
+
+class WorkerNameObserver : public tbb::task_scheduler_observer {
+public:
+  WorkerNameObserver() { observe(true); }
+  ~WorkerNameObserver() override { observe(false); }
+
+  void on_scheduler_entry(bool is_worker) override {
+    if (is_worker && t_thread_name.empty()) {
+      SetThreadName(fmt::format("lumos-worker-{}", m_next_id++));
+    }
+  }
+
+private:
+  std::atomic<int> m_next_id{0};
+};
+} // namespace
+
+TaskGroup::~TaskGroup() {
+  try {
+    m_group.wait();
+  } catch (const std::exception &e) {
+    WARN("task group destroyed without Wait(), task failed: {}", e.what());
+  }
+}
+
+void TaskGroup::Wait() { m_group.wait(); }
+
+void SetThreadName(std::string_view name) {
+  t_thread_name = name;
+#if defined(__linux__)
+  // the kernel limit is 16 bytes including the terminator
+  pthread_setname_np(pthread_self(), t_thread_name.substr(0, 15).c_str());
+#elif defined(__APPLE__)
+  pthread_setname_np(t_thread_name.c_str());
+#endif
+}
+
+const std::string &GetThreadName() { return t_thread_name; }
+
+void EnableWorkerThreadNames() {
+  // never destroyed, workers may still enter the scheduler during exit
+  static WorkerNameObserver *observer = new WorkerNameObserver();
+  (void)observer;
+}
+} // namespace lumos
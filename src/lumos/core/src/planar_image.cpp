@@ -0,0 +1,193 @@
+#include "lumos/core/planar_image.h"
+#include "lumos/core/exception.h"
+#include "lumos/core/parallel.h"
+
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define LUMOS_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace lumos {
+namespace {
+static_assert(sizeof(Color4f) == 4 * sizeof(float));
+static_assert(sizeof(Color4u8) == 4 * sizeof(uint8_t));
+
+constexpr int PLANAR_GRAIN_ROWS = 16;
+
+void checkPlanarChannels(int channels) {
+  if (channels != 3 && channels != 4) {
+    throw RuntimeError("planar image needs 3 or 4 channels, got {}", channels);
+  }
+}
+
+// out[c][x] = in[4 * x + c] for c < channels
+void splitRow(const float *in, float *const *out, int channels, int cols) {
+  int x = 0;
+#ifdef LUMOS_SSE2
+  for (; x + 4 <= cols; x += 4) {
+    __m128 p0 = _mm_loadu_ps(in + 4 * x);
+    __m128 p1 = _mm_loadu_ps(in + 4 * x + 4);
+    __m128 p2 = _mm_loadu_ps(in + 4 * x + 8);
+    __m128 p3 = _mm_loadu_ps(in + 4 * x + 12);
+    _MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+    _mm_storeu_ps(out[0] + x, p0);
+    _mm_storeu_ps(out[1] + x, p1);
+    _mm_storeu_ps(out[2] + x, p2);
+    if (channels == 4) {
+      _mm_storeu_ps(out[3] + x, p3);
+    }
+  }
+#endif
+  for (; x < cols; ++x) {
+    for (int c = 0; c < channels; ++c) {
+      out[c][x] = in[4 * x + c];
+    }
+  }
+}
+
+// in[c][x] -> out[4 * x + c], alpha = `opaque` for 3 planes
+void mergeRow(const float *const *in, float *out, int channels, int cols,
+              float opaque) {
+  int x = 0;
+#ifdef LUMOS_SSE2
+  for (; x + 4 <= cols; x += 4) {
+    __m128 p0 = _mm_loadu_ps(in[0] + x);
+    __m128 p1 = _mm_loadu_ps(in[1] + x);
+    __m128 p2 = _mm_loadu_ps(in[2] + x);
+    __m128 p3 = channels == 4 ? _mm_loadu_ps(in[3] + x) : _mm_set1_ps(opaque);
+    _MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+    _mm_storeu_ps(out + 4 * x, p0);
+    _mm_storeu_ps(out + 4 * x + 4, p1);
+    _mm_storeu_ps(out + 4 * x + 8, p2);
+    _mm_storeu_ps(out + 4 * x + 12, p3);
+  }
+#endif
+  for (; x < cols; ++x) {
+    for (int c = 0; c < 3; ++c) {
+      out[4 * x + c] = in[c][x];
+    }
+    out[4 * x + 3] = channels == 4 ? in[3][x] : opaque;
+  }
+}
+
+void splitRow(const uint8_t *in, uint8_t *const *out, int channels, int cols) {
+  int x = 0;
+#ifdef LUMOS_SSE2
+  const __m128i mask = _mm_set1_epi32(0xff);
+  for (; x + 16 <= cols; x += 16) {
+    __m128i p[4];
+    for (int i = 0; i < 4; ++i) {
+      p[i] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + 4 * x) + i);
+    }
+    for (int c = 0; c < channels; ++c) {
+      // byte c of every pixel as a 32-bit lane, then narrowed 32 -> 8 bits
+      __m128i v[4];
+      for (int i = 0; i < 4; ++i) {
+        v[i] = _mm_and_si128(_mm_srli_epi32(p[i], 8 * c), mask);
+      }
+      __m128i lo = _mm_packs_epi32(v[0], v[1]);
+      __m128i hi = _mm_packs_epi32(v[2], v[3]);
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(out[c] + x),
+                       _mm_packus_epi16(lo, hi));
+    }
+  }
+#endif
+  for (; x < cols; ++x) {
+    for (int c = 0; c < channels; ++c) {
+      out[c][x] = in[4 * x + c];
+    }
+  }
+}
+
+void mergeRow(const uint8_t *const *in, uint8_t *out, int channels, int cols,
+              uint8_t opaque) {
+  int x = 0;
+#ifdef LUMOS_SSE2
+  for (; x + 16 <= cols; x += 16) {
+    __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in[0] + x));
+    __m128i g = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in[1] + x));
+    __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in[2] + x));
+    __m128i a =
+        channels == 4
+            ? _mm_loadu_si128(reinterpret_cast<const __m128i *>(in[3] + x))
+            : _mm_set1_epi8(static_cast<char>(opaque));
+    __m128i rg_lo = _mm_unpacklo_epi8(r, g);
+    __m128i rg_hi = _mm_unpackhi_epi8(r, g);
+    __m128i ba_lo = _mm_unpacklo_epi8(b, a);
+    __m128i ba_hi = _mm_unpackhi_epi8(b, a);
+    __m128i *dst = reinterpret_cast<__m128i *>(out + 4 * x);
+    _mm_storeu_si128(dst, _mm_unpacklo_epi16(rg_lo, ba_lo));
+    _mm_storeu_si128(dst + 1, _mm_unpackhi_epi16(rg_lo, ba_lo));
+    _mm_storeu_si128(dst + 2, _mm_unpacklo_epi16(rg_hi, ba_hi));
+    _mm_storeu_si128(dst + 3, _mm_unpackhi_epi16(rg_hi, ba_hi));
+  }
+#endif
+  for (; x < cols; ++x) {
+    for (int c = 0; c < 3; ++c) {
+      out[4 * x + c] = in[c][x];
+    }
+    out[4 * x + 3] = channels == 4 ? in[3][x] : opaque;
+  }
+}
+
+template <typename Scalar, typename Pixel>
+void toPlanar(const ImageData<Pixel> &src, PlanarImage<Scalar> *dst,
+              int channels) {
+  checkPlanarChannels(channels);
+  int rows = static_cast<int>(src.rows());
+  int cols = static_cast<int>(src.cols());
+  dst->Resize(channels, rows, cols);
+  ParallelFor(0, rows, PLANAR_GRAIN_ROWS, [&](int begin, int end) {
+    for (int y = begin; y < end; ++y) {
+      Scalar *out[4] = {};
+      for (int c = 0; c < channels; ++c) {
+        out[c] = dst->Row(c, y);
+      }
+      splitRow(reinterpret_cast<const Scalar *>(
+                   src.data() + static_cast<std::ptrdiff_t>(y) * cols),
+               out, channels, cols);
+    }
+  });
+}
+
+template <typename Scalar, typename Pixel>
+void fromPlanar(const PlanarImage<Scalar> &src, ImageData<Pixel> *dst,
+                Scalar opaque) {
+  int channels = src.Channels();
+  checkPlanarChannels(channels);
+  int rows = src.Rows();
+  int cols = src.Cols();
+  dst->resize(rows, cols);
+  ParallelFor(0, rows, PLANAR_GRAIN_ROWS, [&](int begin, int end) {
+    for (int y = begin; y < end; ++y) {
+      const Scalar *in[4] = {};
+      for (int c = 0; c < channels; ++c) {
+        in[c] = src.Row(c, y);
+      }
+      mergeRow(in,
+               reinterpret_cast<Scalar *>(
+                   dst->data() + static_cast<std::ptrdiff_t>(y) * cols),
+               channels, cols, opaque);
+    }
+  });
+}
+} // namespace
+
+void ToPlanar(const ImageData4f &src, PlanarImagef *dst, int channels) {
+  toPlanar(src, dst, channels);
+}
+
+void ToPlanar(const ImageData4u8 &src, PlanarImageu8 *dst, int channels) {
+  toPlanar(src, dst, channels);
+}
+
+void FromPlanar(const PlanarImagef &src, ImageData4f *dst) {
+  fromPlanar(src, dst, 1.0f);
+}
+
+void FromPlanar(const PlanarImageu8 &src, ImageData4u8 *dst) {
+  fromPlanar(src, dst, static_cast<uint8_t>(255));
+}
+} // namespace lumos
@@ -0,0 +1,65 @@
+#include "lumos/core/pyramid.h"
+#include "lumos/core/convert.h"
+#include "lumos/core/resample.h"
+
+namespace lumos {
+namespace {
+int levelSize(int size) { return std::max(1, size / 2); }
+
+void downsample(const ImageData4f &src, ImageData4f *dst,
+                PyramidFilter filter) {
+  ResampleSettings settings;
+  settings.filter = filter == PyramidFilter::Kaiser ? ResampleFilter::Kaiser
+                                                    : ResampleFilter::Box;
+  Resample(src, levelSize(static_cast<int>(src.rows())),
+           levelSize(static_cast<int>(src.cols())), dst, settings);
+}
+
+int levelCount(int rows, int cols, int max_levels) {
+  int count = 0;
+  for (int size = std::max(rows, cols); size > 1; size /= 2) {
+    ++count;
+  }
+  return max_levels > 0 ? std::min(count, max_levels) : count;
+}
+} // namespace
+
+void Downsample(const ImageData4f &src, ImageData4f *dst,
+                PyramidFilter filter) {
+  downsample(src, dst, filter);
+}
+
+void BuildPyramid(const ImageData4f &image, std::vector<ImageData4f> *levels,
+                  const PyramidSettings &settings) {
+  int count = levelCount(static_cast<int>(image.rows()),
+                         static_cast<int>(image.cols()), settings.max_levels);
+  DEBUG("build pyramid, size(hxw): {}x{}, levels: {}", image.rows(),
+        image.cols(), count);
+  levels->resize(count);
+  for (int i = 0; i < count; ++i) {
+    downsample(i == 0 ? image : (*levels)[i - 1], &(*levels)[i],
+               settings.filter);
+  }
+}
+
+void BuildPyramid(const ImageData4u8 &image, std::vector<ImageData4u8> *levels,
+                  const PyramidSettings &settings) {
+  ImageData4f linear;
+  if (settings.srgb) {
+    ToLinearRgb(image, &linear);
+  } else {
+    linear = image.unaryExpr([](const Color4u8 &c) { return ToFloat(c); });
+  }
+  std::vector<ImageData4f> linear_levels;
+  BuildPyramid(linear, &linear_levels, settings);
+  levels->resize(linear_levels.size());
+  for (size_t i = 0; i < linear_levels.size(); ++i) {
+    ImageData4f level = std::move(linear_levels[i]);
+    if (settings.srgb) {
+      ToSrgb(level, &level);
+    }
+    // rounding keeps flat and opaque regions at their value
+    QuantizeUint8(level, &(*levels)[i]);
+  }
+}
+} // namespace lumos
@@ -0,0 +1,295 @@
+#include "lumos/core/resample.h"
+#include "lumos/core/buffer_pool.h"
+#include "lumos/core/convert.h"
+#include "lumos/core/exception.h"
+#include "lumos/core/parallel.h"
+
+#include <cmath>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <vector>
+
+namespace lumos {
+namespace {
+constexpr float KAISER_ALPHA = 4.0f;
+constexpr int RESAMPLE_GRAIN_ROWS = 8;
+// distinct (source size, destination size, filter) tables kept around
+constexpr size_t MAX_CACHED_TABLES = 64;
+
+float sinc(float x) {
+  return x == 0.0f ? 1.0f : std::sin(PI * x) / (PI * x);
+}
+
+// modified bessel function of the first kind, order 0 (power series)
+float besselI0(float x) {
+  float half_x = 0.5f * x;
+  float sum = 1.0f;
+  float term = 1.0f;
+  for (int k = 1; term > sum * 1e-7f; ++k) {
+    float factor = half_x / static_cast<float>(k);
+    term *= factor * factor;
+    sum += term;
+  }
+  return sum;
+}
+
+float filterRadius(ResampleFilter filter) {
+  switch (filter) {
+  case ResampleFilter::Bilinear:
+    return 1.0f;
+  case ResampleFilter::Mitchell:
+    return 2.0f;
+  case ResampleFilter::Lanczos3:
+  case ResampleFilter::Kaiser:
+    return 3.0f;
+  default:
+    return 0.5f;
+  }
+}
+
+// `x` in filter units, |x| < filterRadius(filter)
+float evalFilter(ResampleFilter filter, float x) {
+  x = std::abs(x);
+  switch (filter) {
+  case ResampleFilter::Bilinear:
+    return std::max(0.0f, 1.0f - x);
+  case ResampleFilter::Mitchell: {
+    constexpr float B = 1.0f / 3.0f;
+    constexpr float C = 1.0f / 3.0f;
+    if (x < 1.0f) {
+      return ((12 - 9 * B - 6 * C) * x * x * x +
+              (-18 + 12 * B + 6 * C) * x * x + (6 - 2 * B)) /
+             6.0f;
+    }
+    if (x < 2.0f) {
+      return ((-B - 6 * C) * x * x * x + (6 * B + 30 * C) * x * x +
+              (-12 * B - 48 * C) * x + (8 * B + 24 * C)) /
+             6.0f;
+    }
+    return 0.0f;
+  }
+  case ResampleFilter::Lanczos3:
+    return x < 3.0f ? sinc(x) * sinc(x / 3.0f) : 0.0f;
+  case ResampleFilter::Kaiser: {
+    float t = x / 3.0f;
+    if (t >= 1.0f) {
+      return 0.0f;
+    }
+    return sinc(x) * besselI0(KAISER_ALPHA * std::sqrt(1.0f - t * t)) /
+           besselI0(KAISER_ALPHA);
+  }
+  default:
+    return x <= 0.5f ? 1.0f : 0.0f;
+  }
+}
+
+// `taps` source indices (clamped to the edge) and normalized weights per
+// destination sample, zero weights pad every sample to the same tap count
+struct FilterTable {
+  int taps = 0;
+  std::vector<int> index;
+  std::vector<float> weight;
+};
+
+std::shared_ptr<const FilterTable>
+buildFilterTable(int src_size, int dst_size, ResampleFilter filter) {
+  float scale = static_cast<float>(src_size) / static_cast<float>(dst_size);
+  // the filter is widened when shrinking
+  float filter_scale = std::max(scale, 1.0f);
+  float radius = filterRadius(filter) * filter_scale;
+  std::vector<std::vector<std::pair<int, float>>> samples(dst_size);
+  for (int i = 0; i < dst_size; ++i) {
+    auto &sample = samples[i];
+    float center = (static_cast<float>(i) + 0.5f) * scale;
+    auto add = [&](int j, float w) {
+      int index = Clamp(j, 0, src_size - 1);
+      if (!sample.empty() && sample.back().first == index) {
+        sample.back().second += w;
+      } else {
+        sample.emplace_back(index, w);
+      }
+    };
+    if (filter == ResampleFilter::Box && scale > 1.0f) {
+      // overlap of the source pixel [j, j + 1) with the destination pixel
+      float begin = center - 0.5f * scale;
+      float end = center + 0.5f * scale;
+      int first = static_cast<int>(std::floor(begin));
+      int last = static_cast<int>(std::ceil(end)) - 1;
+      for (int j = first; j <= last; ++j) {
+        float overlap = std::min(end, static_cast<float>(j + 1)) -
+                        std::max(begin, static_cast<float>(j));
+        if (overlap > 0.0f) {
+          add(j, overlap);
+        }
+      }
+    } else if (filter == ResampleFilter::Box) {
+      add(static_cast<int>(std::floor(center)), 1.0f);
+    } else {
+      int first = static_cast<int>(std::floor(center - radius));
+      int last = static_cast<int>(std::ceil(center + radius));
+      for (int j = first; j <= last; ++j) {
+        float w = evalFilter(
+            filter, (static_cast<float>(j) + 0.5f - center) / filter_scale);
+        if (w != 0.0f) {
+          add(j, w);
+        }
+      }
+    }
+  }
+  auto table = std::make_shared<FilterTable>();
+  for (const auto &sample : samples) {
+    table->taps = std::max(table->taps, static_cast<int>(sample.size()));
+  }
+  table->index.assign(static_cast<size_t>(dst_size) * table->taps, 0);
+  table->weight.assign(static_cast<size_t>(dst_size) * table->taps, 0.0f);
+  for (int i = 0; i < dst_size; ++i) {
+    float sum = 0.0f;
+    for (const auto &tap : samples[i]) {
+      sum += tap.second;
+    }
+    size_t offset = static_cast<size_t>(i) * table->taps;
+    for (size_t k = 0; k < samples[i].size(); ++k) {
+      table->index[offset + k] = samples[i][k].first;
+      table->weight[offset + k] = samples[i][k].second / sum;
+    }
+    // padding taps repeat the first index with a zero weight
+    for (size_t k = samples[i].size(); k < static_cast<size_t>(table->taps);
+         ++k) {
+      table->index[offset + k] = samples[i][0].first;
+    }
+  }
+  return table;
+}
+
+std::shared_ptr<const FilterTable> getFilterTable(int src_size, int dst_size,
+                                                  ResampleFilter filter) {
+  using Key = std::tuple<int, int, ResampleFilter>;
+  static std::mutex mutex;
+  static std::map<Key, std::shared_ptr<const FilterTable>> cache;
+  Key key{src_size, dst_size, filter};
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = cache.find(key);
+    if (it != cache.end()) {
+      return it->second;
+    }
+  }
+  // built outside of the lock, a concurrent miss just builds it twice
+  auto table = buildFilterTable(src_size, dst_size, filter);
+  std::lock_guard<std::mutex> lock(mutex);
+  if (cache.size() >= MAX_CACHED_TABLES) {
+    cache.clear();
+  }
+  cache.emplace(key, table);
+  return table;
+}
+
+// rows x src_cols -> rows x dst_cols
+void horizontalPass(const Color4f *src, int rows, int src_cols, Color4f *dst,
+                    int dst_cols, const FilterTable &table) {
+  ParallelFor(0, rows, RESAMPLE_GRAIN_ROWS, [&](int begin, int end) {
+    for (int y = begin; y < end; ++y) {
+      const Color4f *in = src + static_cast<std::ptrdiff_t>(y) * src_cols;
+      Color4f *out = dst + static_cast<std::ptrdiff_t>(y) * dst_cols;
+      const int *index = table.index.data();
+      const float *weight = table.weight.data();
+      for (int x = 0; x < dst_cols; ++x) {
+        Color4f acc = Color4f::Zero();
+        for (int k = 0; k < table.taps; ++k) {
+          acc += weight[k] * in[index[k]];
+        }
+        out[x] = acc;
+        index += table.taps;
+        weight += table.taps;
+      }
+    }
+  });
+}
+
+// src_rows x cols -> dst_rows x cols, whole source rows are accumulated
+void verticalPass(const Color4f *src, int cols, Color4f *dst, int dst_rows,
+                  const FilterTable &table) {
+  ParallelFor(0, dst_rows, RESAMPLE_GRAIN_ROWS, [&](int begin, int end) {
+    for (int y = begin; y < end; ++y) {
+      Color4f *out = dst + static_cast<std::ptrdiff_t>(y) * cols;
+      std::fill(out, out + cols, Color4f::Zero());
+      for (int k = 0; k < table.taps; ++k) {
+        size_t tap = static_cast<size_t>(y) * table.taps + k;
+        float w = table.weight[tap];
+        if (w == 0.0f) {
+          continue;
+        }
+        const Color4f *in =
+            src + static_cast<std::ptrdiff_t>(table.index[tap]) * cols;
+        for (int x = 0; x < cols; ++x) {
+          out[x] += w * in[x];
+        }
+      }
+    }
+  });
+}
+
+void checkResampleSize(Eigen::Index rows, Eigen::Index cols, int height,
+                       int width) {
+  if (rows <= 0 || cols <= 0 || height <= 0 || width <= 0) {
+    throw RuntimeError("invalid resample, src(hxw): {}x{}, dst(hxw): {}x{}",
+                       rows, cols, height, width);
+  }
+}
+} // namespace
+
+void Resample(const ImageData4f &src, int height, int width, ImageData4f *dst,
+              const ResampleSettings &settings) {
+  checkResampleSize(src.rows(), src.cols(), height, width);
+  int src_rows = static_cast<int>(src.rows());
+  int src_cols = static_cast<int>(src.cols());
+  auto tx = getFilterTable(src_cols, width, settings.filter);
+  auto ty = getFilterTable(src_rows, height, settings.filter);
+  // horizontal first filters src_rows rows, vertical first only height rows
+  double horizontal_first = static_cast<double>(src_rows) * width * tx->taps +
+                            static_cast<double>(height) * width * ty->taps;
+  double vertical_first = static_cast<double>(height) * src_cols * ty->taps +
+                          static_cast<double>(height) * width * tx->taps;
+  ImageData4f result(height, width);
+  if (horizontal_first <= vertical_first) {
+    PooledBuffer<Color4f> tmp(static_cast<size_t>(src_rows) * width);
+    horizontalPass(src.data(), src_rows, src_cols, tmp.Data(), width, *tx);
+    verticalPass(tmp.Data(), width, result.data(), height, *ty);
+  } else {
+    PooledBuffer<Color4f> tmp(static_cast<size_t>(height) * src_cols);
+    verticalPass(src.data(), src_cols, tmp.Data(), height, *ty);
+    horizontalPass(tmp.Data(), height, src_cols, result.data(), width, *tx);
+  }
+  if (settings.filter != ResampleFilter::Box &&
+      settings.filter != ResampleFilter::Bilinear) {
+    ParallelFor(0, height, RESAMPLE_GRAIN_ROWS, [&](int begin, int end) {
+      Color4f *p = result.data() + static_cast<std::ptrdiff_t>(begin) * width;
+      Color4f *last = result.data() + static_cast<std::ptrdiff_t>(end) * width;
+      for (; p != last; ++p) {
+        *p = p->cwiseMax(0.0f);
+      }
+    });
+  }
+  *dst = std::move(result);
+}
+
+void Resample(const ImageData4u8 &src, int height, int width,
+              ImageData4u8 *dst, const ResampleSettings &settings) {
+  checkResampleSize(src.rows(), src.cols(), height, width);
+  ImageData4f linear;
+  if (settings.srgb) {
+    ToLinearRgb(src, &linear);
+  } else {
+    linear = src.unaryExpr([](const Color4u8 &c) { return ToFloat(c); });
+  }
+  ImageData4f resized;
+  Resample(linear, height, width, &resized, settings);
+  if (settings.srgb) {
+    ToSrgb(resized, &resized);
+  }
+  // rounding keeps flat and opaque regions at their value
+  QuantizeUint8(resized, dst);
+}
+} // namespace lumos
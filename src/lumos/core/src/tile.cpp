@@ -0,0 +1,65 @@
+#include "lumos/core/tile.h"
+#include "lumos/core/exception.h"
+
+namespace lumos {
+namespace {
+constexpr int MIN_TILE_SIZE = 8;
+
+int tileCount(int size, int tile_size, TileEdge edge) {
+  switch (edge) {
+  case TileEdge::Partial:
+    return (size + tile_size - 1) / tile_size;
+  case TileEdge::Merge:
+    return size > 0 ? std::max(1, size / tile_size) : 0;
+  default:
+    return size / tile_size;
+  }
+}
+} // namespace
+
+int TileSizeForCache(size_t pixel_bytes, size_t cache_bytes) {
+  int size = MIN_TILE_SIZE;
+  while (static_cast<size_t>(2 * size) * (2 * size) * pixel_bytes <=
+         cache_bytes) {
+    size *= 2;
+  }
+  return size;
+}
+
+TileGrid::TileGrid(int rows, int cols, const TileSettings &settings)
+    : m_rows(rows), m_cols(cols), m_settings(settings) {
+  if (rows < 0 || cols < 0 || settings.tile_rows <= 0 ||
+      settings.tile_cols <= 0) {
+    throw RuntimeError("invalid tiling, image(hxw): {}x{}, tile(hxw): {}x{}",
+                       rows, cols, settings.tile_rows, settings.tile_cols);
+  }
+  m_tile_rows = tileCount(rows, settings.tile_rows, settings.edge);
+  m_tile_cols = tileCount(cols, settings.tile_cols, settings.edge);
+  if (m_tile_rows == 0 || m_tile_cols == 0) {
+    m_tile_rows = 0;
+    m_tile_cols = 0;
+  }
+}
+
+Tile TileGrid::GetTile(int tile_row, int tile_col) const {
+  Tile tile;
+  tile.tile_row = tile_row;
+  tile.tile_col = tile_col;
+  tile.index = tile_row * m_tile_cols + tile_col;
+  axis(tile_row, m_tile_rows, m_settings.tile_rows, m_rows, &tile.row,
+       &tile.rows);
+  axis(tile_col, m_tile_cols, m_settings.tile_cols, m_cols, &tile.col,
+       &tile.cols);
+  return tile;
+}
+
+void TileGrid::axis(int i, int tiles, int tile_size, int size, int *begin,
+                    int *length) const {
+  *begin = i * tile_size;
+  if (m_settings.edge == TileEdge::Merge && i == tiles - 1) {
+    *length = size - *begin;
+  } else {
+    *length = std::min(tile_size, size - *begin);
+  }
+}
+} // namespace lumos
@@ -0,0 +1,171 @@
+#include "lumos/core/tiled_exr_writer.h"
+#include "lumos/core/buffer_pool.h"
+#include "lumos/core/convert.h"
+#include "lumos/core/exception.h"
+
+#include <ImfHeader.h>
+#include <ImfTiledRgbaFile.h>
+#include <spdlog/fmt/ostr.h>
+
+namespace lumos {
+namespace {
+Imf::LevelMode toImfLevelMode(ExrLevelMode mode) {
+  switch (mode) {
+  case ExrLevelMode::Mipmap:
+    return Imf::MIPMAP_LEVELS;
+  case ExrLevelMode::Ripmap:
+    return Imf::RIPMAP_LEVELS;
+  default:
+    return Imf::ONE_LEVEL;
+  }
+}
+} // namespace
+
+TiledExrWriter::TiledExrWriter(const std::filesystem::path &output,
+                               int display_height, int display_width,
+                               int tile_size, ExrLevelMode level_mode,
+                               const ExrSettings &settings)
+    : m_output(output), m_level_mode(level_mode), m_tile_size(tile_size) {
+  if (display_height <= 0 || display_width <= 0 || tile_size <= 0) {
+    throw RuntimeError("invalid tiled exr: {}, size: {}x{}, tile size: {}",
+                       output, display_height, display_width, tile_size);
+  }
+  DEBUG("open tiled exr file: {}, size(hxw): {}x{}, tile size: {}", output,
+        display_height, display_width, tile_size);
+  Imath::Box2i window{{0, 0}, {display_width - 1, display_height - 1}};
+  Imf::Header header(window, window, 1, Imath::V2f(0, 0), 1, Imf::RANDOM_Y,
+                     static_cast<Imf::Compression>(settings.compression));
+  header.dwaCompressionLevel() = settings.dwa_level;
+  // tiles are compressed one at a time as they arrive, extra exr threads
+  // would have nothing to do
+  m_file = std::make_unique<Imf::TiledRgbaOutputFile>(
+      output.u8string().c_str(), header, Imf::WRITE_RGBA, tile_size, tile_size,
+      toImfLevelMode(level_mode), Imf::ROUND_DOWN, 0);
+  size_t count = 0;
+  m_level_offsets.resize(static_cast<size_t>(LevelsX()) * LevelsY());
+  for (int ly = 0; ly < LevelsY(); ++ly) {
+    for (int lx = 0; lx < LevelsX(); ++lx) {
+      if (level_mode == ExrLevelMode::Mipmap && lx != ly) {
+        continue;
+      }
+      m_level_offsets[ly * LevelsX() + lx] = count;
+      count += static_cast<size_t>(TileRows(ly)) * TileCols(lx);
+    }
+  }
+  m_written.resize(count);
+}
+
+TiledExrWriter::~TiledExrWriter() {
+  size_t count = TileCount();
+  if (m_tiles_written == count) {
+    return;
+  }
+  WARN("close tiled exr file: {} with {}/{} tiles written, the rest is filled "
+       "with zeros",
+       m_output, m_tiles_written.load(), count);
+  try {
+    for (int ly = 0; ly < LevelsY(); ++ly) {
+      for (int lx = 0; lx < LevelsX(); ++lx) {
+        if (m_level_mode == ExrLevelMode::Mipmap && lx != ly) {
+          continue;
+        }
+        for (int r = 0; r < TileRows(ly); ++r) {
+          for (int c = 0; c < TileCols(lx); ++c) {
+            if (m_written[tileIndex(r, c, lx, ly)]) {
+              continue;
+            }
+            int row_offset, col_offset, height, width;
+            TileRegion(r, c, &row_offset, &col_offset, &height, &width, lx,
+                       ly);
+            ImageData4f zeros(height, width);
+            zeros.fill(Color4f(0.0f, 0.0f, 0.0f, 0.0f));
+            WriteTile(r, c, zeros, lx, ly);
+          }
+        }
+      }
+    }
+  } catch (const std::exception &e) {
+    ERROR("failed to fill the missing tiles of: {}, {}", m_output, e.what());
+  }
+}
+
+int TiledExrWriter::LevelsX() const { return m_file->numXLevels(); }
+
+int TiledExrWriter::LevelsY() const { return m_file->numYLevels(); }
+
+int TiledExrWriter::LevelWidth(int level_x) const {
+  return m_file->levelWidth(level_x);
+}
+
+int TiledExrWriter::LevelHeight(int level_y) const {
+  return m_file->levelHeight(level_y);
+}
+
+int TiledExrWriter::TileCols(int level_x) const {
+  return m_file->numXTiles(level_x);
+}
+
+int TiledExrWriter::TileRows(int level_y) const {
+  return m_file->numYTiles(level_y);
+}
+
+void TiledExrWriter::checkTile(int tile_row, int tile_col, int level_x,
+                               int level_y) const {
+  if (!m_file->isValidTile(tile_col, tile_row, level_x, level_y)) {
+    throw RuntimeError("invalid tile: {}, tile (row, col): ({}, {}), level "
+                       "(x, y): ({}, {})",
+                       m_output, tile_row, tile_col, level_x, level_y);
+  }
+}
+
+size_t TiledExrWriter::tileIndex(int tile_row, int tile_col, int level_x,
+                                 int level_y) const {
+  return m_level_offsets[level_y * LevelsX() + level_x] +
+         static_cast<size_t>(tile_row) * TileCols(level_x) + tile_col;
+}
+
+void TiledExrWriter::TileRegion(int tile_row, int tile_col, int *row_offset,
+                                int *col_offset, int *height, int *width,
+                                int level_x, int level_y) const {
+  checkTile(tile_row, tile_col, level_x, level_y);
+  Imath::Box2i box =
+      m_file->dataWindowForTile(tile_col, tile_row, level_x, level_y);
+  *row_offset = box.min.y;
+  *col_offset = box.min.x;
+  *height = box.max.y - box.min.y + 1;
+  *width = box.max.x - box.min.x + 1;
+}
+
+void TiledExrWriter::WriteTile(int tile_row, int tile_col,
+                               const ImageData4f &tile, int level_x,
+                               int level_y) {
+  int row_offset, col_offset, height, width;
+  TileRegion(tile_row, tile_col, &row_offset, &col_offset, &height, &width,
+             level_x, level_y);
+  if (tile.rows() != height || tile.cols() != width) {
+    throw RuntimeError("tile size mismatch: {}, tile (row, col): ({}, {}), "
+                       "expect(hxw): {}x{}, got(hxw): {}x{}",
+                       m_output, tile_row, tile_col, height, width,
+                       tile.rows(), tile.cols());
+  }
+  // convert outside of the lock so that several threads only serialize on
+  // the compression and the write itself
+  PooledBuffer<Imf::Rgba> pixels(static_cast<size_t>(tile.size()));
+  FloatToHalf(tile.data(), pixels.Data(), pixels.Size());
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    size_t index = tileIndex(tile_row, tile_col, level_x, level_y);
+    if (m_written[index]) {
+      throw RuntimeError("tile written twice: {}, tile (row, col): ({}, {}), "
+                         "level (x, y): ({}, {})",
+                         m_output, tile_row, tile_col, level_x, level_y);
+    }
+    m_file->setFrameBuffer(pixels.Data() - col_offset -
+                               static_cast<std::ptrdiff_t>(row_offset) * width,
+                           1, width);
+    m_file->writeTile(tile_col, tile_row, level_x, level_y);
+    m_written[index] = true;
+  }
+  ++m_tiles_written;
+}
+} // namespace lumos
@@ -0,0 +1,104 @@
+#include "lumos/core/tonemap.h"
+#include "lumos/core/color.h"
+#include "lumos/core/convert.h"
+#include "lumos/core/parallel.h"
+
+#include <array>
+#include <cmath>
+
+namespace lumos {
+namespace {
+// pixels tonemapped at once, the buffer stays in L1
+constexpr int BATCH_PIXELS = 256;
+constexpr int GRAIN_ROWS = 8;
+
+// (b + 0.5) / 16 for the 4x4 Bayer matrix, thresholds in (0, 1)
+constexpr std::array<std::array<float, 4>, 4> BAYER_4X4{{
+    {0.5f / 16, 8.5f / 16, 2.5f / 16, 10.5f / 16},
+    {12.5f / 16, 4.5f / 16, 14.5f / 16, 6.5f / 16},
+    {3.5f / 16, 11.5f / 16, 1.5f / 16, 9.5f / 16},
+    {15.5f / 16, 7.5f / 16, 13.5f / 16, 5.5f / 16},
+}};
+
+inline float reinhard(float x) { return x / (1.0f + x); }
+
+inline float acesFit(float x) {
+  constexpr float a = 2.51f, b = 0.03f, c = 2.43f, d = 0.59f, e = 0.14f;
+  return (x * (a * x + b)) / (x * (c * x + d) + e);
+}
+
+template <TonemapOperator Op>
+void applyOperator(Color4f *pixels, int count, float scale) {
+  for (int i = 0; i < count; ++i) {
+    Color4f &c = pixels[i];
+    for (int k = 0; k < 3; ++k) {
+      // negative values (and NaN) are clamped to zero first, the upper bound
+      // is left to the quantization after the sRGB encode
+      float x = std::max(0.0f, c[k] * scale);
+      if constexpr (Op == TonemapOperator::Clamp) {
+        c[k] = x;
+      } else if constexpr (Op == TonemapOperator::Reinhard) {
+        c[k] = reinhard(x);
+      } else {
+        c[k] = acesFit(x);
+      }
+    }
+  }
+}
+
+inline uint8_t quantize(float value, float threshold) {
+  return static_cast<uint8_t>(
+      std::min(Clamp(value, 0.0f, 1.0f) * 255.0f + threshold, 255.0f));
+}
+
+template <TonemapOperator Op>
+void tonemapRow(const Color4f *src, Color4u8 *dst, int width, int row,
+                const TonemapSettings &settings) {
+  std::array<Color4f, BATCH_PIXELS> buffer;
+  float scale = std::exp2(settings.exposure);
+  const auto &bayer = BAYER_4X4[row & 3];
+  for (int x = 0; x < width; x += BATCH_PIXELS) {
+    int n = std::min(BATCH_PIXELS, width - x);
+    std::copy(src + x, src + x + n, buffer.begin());
+    applyOperator<Op>(buffer.data(), n, scale);
+    LinearToSrgb(buffer.data(), buffer.data(), n);
+    for (int i = 0; i < n; ++i) {
+      const Color4f &c = buffer[i];
+      float t = settings.dither ? bayer[(x + i) & 3] : 0.0f;
+      dst[x + i] = Color4u8(quantize(c.r(), t), quantize(c.g(), t),
+                            quantize(c.b(), t), quantize(c.a(), 0.0f));
+    }
+  }
+}
+
+template <TonemapOperator Op>
+void tonemapImage(const ImageData4f &src, ImageData4u8 *dst,
+                  const TonemapSettings &settings) {
+  int width = static_cast<int>(src.cols());
+  ParallelFor(0, static_cast<int>(src.rows()), GRAIN_ROWS,
+              [&](int begin, int end) {
+                for (int r = begin; r < end; ++r) {
+                  std::ptrdiff_t offset = static_cast<std::ptrdiff_t>(r) * width;
+                  tonemapRow<Op>(src.data() + offset, dst->data() + offset,
+                                 width, r, settings);
+                }
+              });
+}
+} // namespace
+
+void Tonemap(const ImageData4f &src, ImageData4u8 *dst,
+             const TonemapSettings &settings) {
+  dst->resize(src.rows(), src.cols());
+  switch (settings.op) {
+  case TonemapOperator::Clamp:
+    tonemapImage<TonemapOperator::Clamp>(src, dst, settings);
+    break;
+  case TonemapOperator::Reinhard:
+    tonemapImage<TonemapOperator::Reinhard>(src, dst, settings);
+    break;
+  case TonemapOperator::AcesFit:
+    tonemapImage<TonemapOperator::AcesFit>(src, dst, settings);
+    break;
+  }
+}
+} // namespace lumos
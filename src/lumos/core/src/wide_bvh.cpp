@@ -0,0 +1,707 @@
+#include "lumos/core/wide_bvh.h"
+#include "lumos/core/exception.h"
+#include "lumos/core/parallel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define LUMOS_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define LUMOS_TARGET_AVX
+#define LUMOS_FLATTEN
+#else
+#define LUMOS_TARGET_AVX __attribute__((target("avx")))
+// inlines the whole traversal into the entry point, the node test of the avx
+// kernel cannot be inlined into a caller without the avx target otherwise
+#define LUMOS_FLATTEN __attribute__((flatten))
+#endif
+#endif
+
+namespace lumos {
+namespace {
+static_assert(sizeof(WideBvhNode<4>) == 112);
+static_assert(sizeof(WideBvhNode<8>) == 224);
+static_assert(sizeof(TrianglePacket) == 160);
+
+// packets per task when filling them
+constexpr int PACKET_GRAIN = 16 * 1024;
+
+template <int Width> struct Collapser {
+  const Bvh &bvh;
+  std::vector<WideBvhNode<Width>> *nodes;
+
+  // fills wide node `index` from the subtree under binary node `binary`,
+  // returns the depth in wide nodes
+  int Collapse(uint32_t binary, uint32_t index) {
+    const std::vector<BvhNode> &binary_nodes = bvh.Nodes();
+    uint32_t children[Width];
+    int count = 0;
+    if (binary_nodes[binary].IsLeaf()) {
+      // only for a root that is a leaf
+      children[count++] = binary;
+    } else {
+      children[count++] = binary_nodes[binary].offset;
+      children[count++] = binary_nodes[binary].offset + 1;
+    }
+    while (count < Width) {
+      int largest = -1;
+      float largest_area = -1.0f;
+      for (int i = 0; i < count; ++i) {
+        const BvhNode &child = binary_nodes[children[i]];
+        float area = child.bounds.SurfaceArea();
+        if (!child.IsLeaf() && area > largest_area) {
+          largest = i;
+          largest_area = area;
+        }
+      }
+      if (largest < 0) {
+        break;
+      }
+      uint32_t opened = binary_nodes[children[largest]].offset;
+      children[largest] = opened;
+      children[count++] = opened + 1;
+    }
+
+    WideBvhNode<Width> node;
+    std::fill_n(&node.lower[0][0], 3 * Width,
+                std::numeric_limits<float>::infinity());
+    std::fill_n(&node.upper[0][0], 3 * Width,
+                -std::numeric_limits<float>::infinity());
+    std::fill_n(node.children, Width, INVALID_INDEX);
+    uint32_t first_child = static_cast<uint32_t>(nodes->size());
+    int interior = 0;
+    for (int i = 0; i < count; ++i) {
+      const BvhNode &child = binary_nodes[children[i]];
+      for (int axis = 0; axis < 3; ++axis) {
+        node.lower[axis][i] = child.bounds.min[axis];
+        node.upper[axis][i] = child.bounds.max[axis];
+      }
+      if (!child.IsLeaf()) {
+        node.children[i] = first_child + interior++;
+        continue;
+      }
+      if (child.count > WideBvh<Width>::MAX_LEAF_TRIANGLES) {
+        throw RuntimeError("leaf of {} triangles, a wide bvh takes at most {}",
+                           child.count, WideBvh<Width>::MAX_LEAF_TRIANGLES);
+      }
+      // the packets hold the triangles in the leaf order of the binary bvh
+      uint32_t count_minus_one = child.count - 1u;
+      node.children[i] = WideBvh<Width>::LEAF_BIT |
+                         count_minus_one << WideBvh<Width>::LEAF_COUNT_SHIFT |
+                         child.offset;
+    }
+    // siblings are adjacent, created before any of them is descended into
+    nodes->resize(nodes->size() + interior);
+    (*nodes)[index] = node;
+    int depth = 0;
+    for (int i = 0; i < count; ++i) {
+      if (!binary_nodes[children[i]].IsLeaf()) {
+        depth = std::max(depth, Collapse(children[i], node.children[i]));
+      }
+    }
+    return depth + 1;
+  }
+};
+
+double toMiB(size_t bytes) { return bytes / (1024.0 * 1024.0); }
+
+int lowestBit(uint32_t mask) {
+#if defined(_MSC_VER) && !defined(__clang__)
+  unsigned long index;
+  _BitScanForward(&index, mask);
+  return static_cast<int>(index);
+#else
+  return __builtin_ctz(mask);
+#endif
+}
+
+// the node tests return the mask of the child boxes hit in [t_min, t_max] and
+// store the entry distances of all children in `t_near`. Like
+// Bounds3f::Intersect a NaN slab (0 * inf) keeps the current interval
+template <int Width> struct ScalarNodeTest {
+  Vector3f origin;
+  Vector3f inv_direction;
+  float t_min;
+
+  ScalarNodeTest(const Ray &ray, const Vector3f &inv_direction)
+      : origin(ray.origin), inv_direction(inv_direction), t_min(ray.t_min) {}
+
+  int Children(const WideBvhNode<Width> &node, float t_max,
+               float *t_near) const {
+    int mask = 0;
+    for (int i = 0; i < Width; ++i) {
+      float t0_max = t_min;
+      float t1_min = t_max;
+      for (int axis = 0; axis < 3; ++axis) {
+        float t0 = (node.lower[axis][i] - origin[axis]) * inv_direction[axis];
+        float t1 = (node.upper[axis][i] - origin[axis]) * inv_direction[axis];
+        if (inv_direction[axis] < 0.0f) {
+          std::swap(t0, t1);
+        }
+        t0_max = t0 > t0_max ? t0 : t0_max;
+        t1_min = t1 < t1_min ? t1 : t1_min;
+      }
+      t_near[i] = t0_max;
+      mask |= t0_max <= t1_min ? 1 << i : 0;
+    }
+    return mask;
+  }
+};
+
+struct ScalarPacketTest {
+  const Ray &ray;
+
+  explicit ScalarPacketTest(const Ray &ray) : ray(ray) {}
+
+  bool Closest(const TrianglePacket &packet, int lanes,
+               RayHit *closest) const {
+    bool found = false;
+    for (int lane = 0; lane < 4; ++lane) {
+      if ((lanes >> lane & 1) == 0) {
+        continue;
+      }
+      Vector3f p0, e1, e2;
+      load(packet, lane, &p0, &e1, &e2);
+      if (IntersectTriangleEdges(ray, p0, e1, e2, closest->t, &closest->t,
+                                 &closest->u, &closest->v)) {
+        closest->triangle = packet.triangles[lane];
+        found = true;
+      }
+    }
+    return found;
+  }
+
+  bool Any(const TrianglePacket &packet, int lanes, float t_max) const {
+    for (int lane = 0; lane < 4; ++lane) {
+      if ((lanes >> lane & 1) == 0) {
+        continue;
+      }
+      Vector3f p0, e1, e2;
+      load(packet, lane, &p0, &e1, &e2);
+      float t, u, v;
+      if (IntersectTriangleEdges(ray, p0, e1, e2, t_max, &t, &u, &v)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  static void load(const TrianglePacket &packet, int lane, Vector3f *p0,
+                   Vector3f *e1, Vector3f *e2) {
+    for (int axis = 0; axis < 3; ++axis) {
+      (*p0)[axis] = packet.p0[axis][lane];
+      (*e1)[axis] = packet.e1[axis][lane];
+      (*e2)[axis] = packet.e2[axis][lane];
+    }
+  }
+};
+
+#ifdef LUMOS_X86
+// offsets of the entry and exit slab of each axis from WideBvhNode::lower,
+// the entry slab is the upper one for a negative direction
+template <int Width> struct SlabOffsets {
+  int entry[3];
+  int exit[3];
+
+  explicit SlabOffsets(const Vector3f &inv_direction) {
+    for (int axis = 0; axis < 3; ++axis) {
+      bool negative = inv_direction[axis] < 0.0f;
+      entry[axis] = (negative ? 3 * Width : 0) + axis * Width;
+      exit[axis] = (negative ? 0 : 3 * Width) + axis * Width;
+    }
+  }
+};
+
+struct SseNodeTest {
+  SlabOffsets<4> slabs;
+  __m128 origin[3];
+  __m128 inv_direction[3];
+  __m128 t_min;
+
+  SseNodeTest(const Ray &ray, const Vector3f &inv_direction)
+      : slabs(inv_direction), t_min(_mm_set1_ps(ray.t_min)) {
+    for (int axis = 0; axis < 3; ++axis) {
+      origin[axis] = _mm_set1_ps(ray.origin[axis]);
+      this->inv_direction[axis] = _mm_set1_ps(inv_direction[axis]);
+    }
+  }
+
+  int Children(const WideBvhNode<4> &node, float t_max, float *t_near) const {
+    const float *planes = &node.lower[0][0];
+    __m128 t0_max = t_min;
+    __m128 t1_min = _mm_set1_ps(t_max);
+    for (int axis = 0; axis < 3; ++axis) {
+      __m128 t0 = _mm_mul_ps(
+          _mm_sub_ps(_mm_load_ps(planes + slabs.entry[axis]), origin[axis]),
+          inv_direction[axis]);
+      __m128 t1 = _mm_mul_ps(
+          _mm_sub_ps(_mm_load_ps(planes + slabs.exit[axis]), origin[axis]),
+          inv_direction[axis]);
+      // maxps and minps return the second operand for a NaN
+      t0_max = _mm_max_ps(t0, t0_max);
+      t1_min = _mm_min_ps(t1, t1_min);
+    }
+    _mm_storeu_ps(t_near, t0_max);
+    return _mm_movemask_ps(_mm_cmple_ps(t0_max, t1_min));
+  }
+};
+
+struct AvxNodeTest {
+  SlabOffsets<8> slabs;
+  __m256 origin[3];
+  __m256 inv_direction[3];
+  __m256 t_min;
+
+  LUMOS_TARGET_AVX AvxNodeTest(const Ray &ray, const Vector3f &inv_direction)
+      : slabs(inv_direction), t_min(_mm256_set1_ps(ray.t_min)) {
+    for (int axis = 0; axis < 3; ++axis) {
+      origin[axis] = _mm256_set1_ps(ray.origin[axis]);
+      this->inv_direction[axis] = _mm256_set1_ps(inv_direction[axis]);
+    }
+  }
+
+  LUMOS_TARGET_AVX int Children(const WideBvhNode<8> &node, float t_max,
+                                float *t_near) const {
+    const float *planes = &node.lower[0][0];
+    __m256 t0_max = t_min;
+    __m256 t1_min = _mm256_set1_ps(t_max);
+    for (int axis = 0; axis < 3; ++axis) {
+      __m256 t0 = _mm256_mul_ps(
+          _mm256_sub_ps(_mm256_load_ps(planes + slabs.entry[axis]),
+                        origin[axis]),
+          inv_direction[axis]);
+      __m256 t1 = _mm256_mul_ps(
+          _mm256_sub_ps(_mm256_load_ps(planes + slabs.exit[axis]),
+                        origin[axis]),
+          inv_direction[axis]);
+      t0_max = _mm256_max_ps(t0, t0_max);
+      t1_min = _mm256_min_ps(t1, t1_min);
+    }
+    _mm256_storeu_ps(t_near, t0_max);
+    return _mm256_movemask_ps(_mm256_cmp_ps(t0_max, t1_min, _CMP_LE_OQ));
+  }
+};
+
+// Moller-Trumbore on the four lanes of a packet with the operations of
+// IntersectTriangleEdges in the same order (Eigen sums a 3-vector dot product
+// as x + (y + z)), so that both find the same hits
+struct SsePacketTest {
+  __m128 origin[3];
+  __m128 direction[3];
+  __m128 t_min;
+
+  explicit SsePacketTest(const Ray &ray) : t_min(_mm_set1_ps(ray.t_min)) {
+    for (int axis = 0; axis < 3; ++axis) {
+      origin[axis] = _mm_set1_ps(ray.origin[axis]);
+      direction[axis] = _mm_set1_ps(ray.direction[axis]);
+    }
+  }
+
+  // mask of the lanes hit in (t_min, t_max)
+  int Hits(const TrianglePacket &packet, float t_max, __m128 *t, __m128 *u,
+           __m128 *v) const {
+    __m128 e1[3], e2[3], s[3];
+    for (int axis = 0; axis < 3; ++axis) {
+      e1[axis] = _mm_loadu_ps(packet.e1[axis]);
+      e2[axis] = _mm_loadu_ps(packet.e2[axis]);
+      s[axis] = _mm_sub_ps(origin[axis], _mm_loadu_ps(packet.p0[axis]));
+    }
+    __m128 p[3], q[3];
+    cross(direction, e2, p);
+    __m128 det = dot(e1, p);
+    __m128 abs_det = _mm_andnot_ps(_mm_set1_ps(-0.0f), det);
+    __m128 infinity = _mm_set1_ps(std::numeric_limits<float>::infinity());
+    // finite and not 0, false for a NaN as well
+    __m128 valid = _mm_and_ps(_mm_cmpneq_ps(det, _mm_setzero_ps()),
+                              _mm_cmplt_ps(abs_det, infinity));
+    __m128 inv_det = _mm_div_ps(_mm_set1_ps(1.0f), det);
+    __m128 b1 = _mm_mul_ps(dot(s, p), inv_det);
+    cross(s, e1, q);
+    __m128 b2 = _mm_mul_ps(dot(direction, q), inv_det);
+    __m128 hit_t = _mm_mul_ps(dot(e2, q), inv_det);
+    __m128 zero = _mm_setzero_ps();
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 outside =
+        _mm_or_ps(_mm_or_ps(_mm_cmplt_ps(b1, zero), _mm_cmpgt_ps(b1, one)),
+                  _mm_or_ps(_mm_cmplt_ps(b2, zero),
+                            _mm_cmpgt_ps(_mm_add_ps(b1, b2), one)));
+    __m128 inside = _mm_and_ps(_mm_cmpgt_ps(hit_t, t_min),
+                               _mm_cmplt_ps(hit_t, _mm_set1_ps(t_max)));
+    *t = hit_t;
+    *u = b1;
+    *v = b2;
+    return _mm_movemask_ps(_mm_andnot_ps(outside, _mm_and_ps(valid, inside)));
+  }
+
+  bool Closest(const TrianglePacket &packet, int lanes,
+               RayHit *closest) const {
+    __m128 t, u, v;
+    int mask = Hits(packet, closest->t, &t, &u, &v) & lanes;
+    if (mask == 0) {
+      return false;
+    }
+    alignas(16) float ts[4], us[4], vs[4];
+    _mm_store_ps(ts, t);
+    _mm_store_ps(us, u);
+    _mm_store_ps(vs, v);
+    // the first of the nearest lanes, as testing them in order would pick
+    int best = lowestBit(mask);
+    for (mask &= mask - 1; mask != 0; mask &= mask - 1) {
+      int lane = lowestBit(mask);
+      best = ts[lane] < ts[best] ? lane : best;
+    }
+    closest->t = ts[best];
+    closest->u = us[best];
+    closest->v = vs[best];
+    closest->triangle = packet.triangles[best];
+    return true;
+  }
+
+  bool Any(const TrianglePacket &packet, int lanes, float t_max) const {
+    __m128 t, u, v;
+    return (Hits(packet, t_max, &t, &u, &v) & lanes) != 0;
+  }
+
+  static void cross(const __m128 *a, const __m128 *b, __m128 *c) {
+    c[0] = _mm_sub_ps(_mm_mul_ps(a[1], b[2]), _mm_mul_ps(a[2], b[1]));
+    c[1] = _mm_sub_ps(_mm_mul_ps(a[2], b[0]), _mm_mul_ps(a[0], b[2]));
+    c[2] = _mm_sub_ps(_mm_mul_ps(a[0], b[1]), _mm_mul_ps(a[1], b[0]));
+  }
+
+  static __m128 dot(const __m128 *a, const __m128 *b) {
+    return _mm_add_ps(_mm_mul_ps(a[0], b[0]),
+                      _mm_add_ps(_mm_mul_ps(a[1], b[1]),
+                                 _mm_mul_ps(a[2], b[2])));
+  }
+};
+#endif
+
+// a child reference and the distance at which the ray enters its box
+struct StackEntry {
+  uint32_t child;
+  float t_near;
+};
+
+template <int Width>
+constexpr int STACK_SIZE = Bvh::MAX_DEPTH * (Width - 1) + 1;
+
+// the triangles [first, last) of a leaf reference
+template <int Width>
+void leafRange(uint32_t child, uint32_t *first, uint32_t *last) {
+  *first = child & (WideBvh<Width>::MAX_TRIANGLES - 1);
+  *last = *first +
+          ((child & ~WideBvh<Width>::LEAF_BIT) >>
+           WideBvh<Width>::LEAF_COUNT_SHIFT) +
+          1;
+}
+
+// lanes of `packet` inside the triangles [first, last)
+int laneMask(uint32_t packet, uint32_t first, uint32_t last) {
+  uint32_t begin = 4 * packet;
+  int low = first > begin ? static_cast<int>(first - begin) : 0;
+  int high = std::min(static_cast<int>(last - begin), 4);
+  return ((1 << high) - 1) & ~((1 << low) - 1);
+}
+
+template <int Width, typename NodeTest, typename PacketTest>
+bool closestHit(const WideBvhNode<Width> *nodes,
+                const TrianglePacket *packets, const Ray &ray, RayHit *hit) {
+  NodeTest node_test(ray, ray.direction.cwiseInverse());
+  PacketTest packet_test(ray);
+  RayHit closest;
+  closest.t = ray.t_max;
+  StackEntry stack[STACK_SIZE<Width>];
+  int stack_size = 0;
+  uint32_t child = 0;
+  while (true) {
+    if ((child & WideBvh<Width>::LEAF_BIT) == 0) {
+      const WideBvhNode<Width> &node = nodes[child];
+      alignas(4 * Width) float t_near[Width];
+      int mask = node_test.Children(node, closest.t, t_near);
+      if (mask != 0) {
+        int first = lowestBit(mask);
+        mask &= mask - 1;
+        if (mask == 0) {
+          child = node.children[first];
+          continue;
+        }
+        // the hit children sorted far to near, the nearest is visited next
+        // and the others are pushed so that nearer ones are popped first
+        StackEntry hits[Width];
+        int hit_count = 0;
+        hits[hit_count++] = {node.children[first], t_near[first]};
+        for (; mask != 0; mask &= mask - 1) {
+          int i = lowestBit(mask);
+          StackEntry entry{node.children[i], t_near[i]};
+          int j = hit_count++;
+          for (; j > 0 && hits[j - 1].t_near < entry.t_near; --j) {
+            hits[j] = hits[j - 1];
+          }
+          hits[j] = entry;
+        }
+        for (int i = 0; i < hit_count - 1; ++i) {
+          stack[stack_size++] = hits[i];
+        }
+        child = hits[hit_count - 1].child;
+        continue;
+      }
+    } else {
+      uint32_t first, last;
+      leafRange<Width>(child, &first, &last);
+      for (uint32_t i = first / 4; 4 * i < last; ++i) {
+        packet_test.Closest(packets[i], laneMask(i, first, last), &closest);
+      }
+    }
+    // entries behind the closest hit found since they were pushed are culled
+    while (stack_size > 0 && stack[stack_size - 1].t_near > closest.t) {
+      --stack_size;
+    }
+    if (stack_size == 0) {
+      break;
+    }
+    child = stack[--stack_size].child;
+  }
+  if (!closest.Valid()) {
+    return false;
+  }
+  *hit = closest;
+  return true;
+}
+
+template <int Width, typename NodeTest, typename PacketTest>
+bool anyHit(const WideBvhNode<Width> *nodes, const TrianglePacket *packets,
+            const Ray &ray) {
+  NodeTest node_test(ray, ray.direction.cwiseInverse());
+  PacketTest packet_test(ray);
+  uint32_t stack[STACK_SIZE<Width>];
+  int stack_size = 0;
+  uint32_t child = 0;
+  while (true) {
+    if ((child & WideBvh<Width>::LEAF_BIT) == 0) {
+      const WideBvhNode<Width> &node = nodes[child];
+      alignas(4 * Width) float t_near[Width];
+      int mask = node_test.Children(node, ray.t_max, t_near);
+      if (mask != 0) {
+        child = node.children[lowestBit(mask)];
+        for (mask &= mask - 1; mask != 0; mask &= mask - 1) {
+          stack[stack_size++] = node.children[lowestBit(mask)];
+        }
+        continue;
+      }
+    } else {
+      uint32_t first, last;
+      leafRange<Width>(child, &first, &last);
+      for (uint32_t i = first / 4; 4 * i < last; ++i) {
+        if (packet_test.Any(packets[i], laneMask(i, first, last),
+                            ray.t_max)) {
+          return true;
+        }
+      }
+    }
+    if (stack_size == 0) {
+      break;
+    }
+    child = stack[--stack_size];
+  }
+  return false;
+}
+
+template <int Width>
+using IntersectFunc = bool (*)(const WideBvhNode<Width> *,
+                               const TrianglePacket *, const Ray &, RayHit *);
+template <int Width>
+using OccludedFunc = bool (*)(const WideBvhNode<Width> *,
+                              const TrianglePacket *, const Ray &);
+
+#ifdef LUMOS_X86
+bool detectAvx() {
+#if defined(_MSC_VER) && !defined(__clang__)
+  int info[4];
+  __cpuid(info, 1);
+  bool osxsave = (info[2] & (1 << 27)) != 0;
+  bool avx = (info[2] & (1 << 28)) != 0;
+  // the os has to save the ymm registers as well
+  return osxsave && avx && (_xgetbv(0) & 0x6) == 0x6;
+#else
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx");
+#endif
+}
+
+LUMOS_FLATTEN bool intersect4Sse(const WideBvhNode<4> *nodes,
+                                 const TrianglePacket *packets, const Ray &ray,
+                                 RayHit *hit) {
+  return closestHit<4, SseNodeTest, SsePacketTest>(nodes, packets, ray, hit);
+}
+
+LUMOS_FLATTEN bool occluded4Sse(const WideBvhNode<4> *nodes,
+                                const TrianglePacket *packets,
+                                const Ray &ray) {
+  return anyHit<4, SseNodeTest, SsePacketTest>(nodes, packets, ray);
+}
+
+LUMOS_TARGET_AVX LUMOS_FLATTEN bool
+intersect8Avx(const WideBvhNode<8> *nodes, const TrianglePacket *packets,
+              const Ray &ray, RayHit *hit) {
+  return closestHit<8, AvxNodeTest, SsePacketTest>(nodes, packets, ray, hit);
+}
+
+LUMOS_TARGET_AVX LUMOS_FLATTEN bool occluded8Avx(const WideBvhNode<8> *nodes,
+                                                 const TrianglePacket *packets,
+                                                 const Ray &ray) {
+  return anyHit<8, AvxNodeTest, SsePacketTest>(nodes, packets, ray);
+}
+#endif
+
+template <int Width>
+bool intersectScalar(const WideBvhNode<Width> *nodes,
+                     const TrianglePacket *packets, const Ray &ray,
+                     RayHit *hit) {
+  return closestHit<Width, ScalarNodeTest<Width>, ScalarPacketTest>(
+      nodes, packets, ray, hit);
+}
+
+template <int Width>
+bool occludedScalar(const WideBvhNode<Width> *nodes,
+                    const TrianglePacket *packets, const Ray &ray) {
+  return anyHit<Width, ScalarNodeTest<Width>, ScalarPacketTest>(nodes,
+                                                                 packets, ray);
+}
+
+struct WideBvhKernels {
+  IntersectFunc<4> intersect4 = intersectScalar<4>;
+  OccludedFunc<4> occluded4 = occludedScalar<4>;
+  IntersectFunc<8> intersect8 = intersectScalar<8>;
+  OccludedFunc<8> occluded8 = occludedScalar<8>;
+  bool avx = false;
+
+  WideBvhKernels() {
+#ifdef LUMOS_X86
+    intersect4 = intersect4Sse;
+    occluded4 = occluded4Sse;
+    if (detectAvx()) {
+      intersect8 = intersect8Avx;
+      occluded8 = occluded8Avx;
+      avx = true;
+    }
+    DEBUG("wide bvh node test kernels: sse, {}", avx ? "avx" : "scalar");
+#else
+    DEBUG("wide bvh node test kernels: scalar");
+#endif
+  }
+};
+
+const WideBvhKernels &getKernels() {
+  static WideBvhKernels kernels;
+  return kernels;
+}
+} // namespace
+
+template <int Width>
+WideBvh<Width>::WideBvh(const Bvh &bvh) : m_mesh(&bvh.Mesh()) {
+  collapse(bvh);
+}
+
+template <int Width>
+WideBvh<Width>::WideBvh(const TriangleMesh &mesh, const BvhSettings &settings)
+    : m_mesh(&mesh) {
+  collapse(Bvh(mesh, settings));
+}
+
+template <int Width> void WideBvh<Width>::collapse(const Bvh &bvh) {
+  if (bvh.Nodes().empty()) {
+    return;
+  }
+  const std::vector<uint32_t> &triangles = bvh.Triangles();
+  if (triangles.size() > MAX_TRIANGLES) {
+    throw RuntimeError("{} triangles, a wide bvh takes at most {}",
+                       triangles.size(), MAX_TRIANGLES);
+  }
+  auto start = std::chrono::steady_clock::now();
+  m_bounds = bvh.Bounds();
+  Collapser<Width> collapser{bvh, &m_nodes};
+  m_nodes.resize(1);
+  m_depth = collapser.Collapse(0, 0);
+  m_nodes.shrink_to_fit();
+
+  int count = static_cast<int>(triangles.size());
+  int packet_count = (count + 3) / 4;
+  m_packets.resize(packet_count);
+  ParallelFor(0, packet_count, PACKET_GRAIN, [&](int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+      TrianglePacket &packet = m_packets[i];
+      for (int lane = 0; lane < 4 && 4 * i + lane < count; ++lane) {
+        uint32_t triangle = triangles[4 * i + lane];
+        Vector3f p0, p1, p2;
+        m_mesh->TrianglePositions(triangle, &p0, &p1, &p2);
+        Vector3f e1 = p1 - p0;
+        Vector3f e2 = p2 - p0;
+        for (int axis = 0; axis < 3; ++axis) {
+          packet.p0[axis][lane] = p0[axis];
+          packet.e1[axis][lane] = e1[axis];
+          packet.e2[axis][lane] = e2[axis];
+        }
+        packet.triangles[lane] = triangle;
+      }
+    }
+  });
+
+  double ms = std::chrono::duration<double, std::milli>(
+                  std::chrono::steady_clock::now() - start)
+                  .count();
+  INFO("bvh{}: {} nodes, {} triangle packets, depth {}, collapsed in {:.1f} "
+       "ms, {:.1f} MiB",
+       Width, m_nodes.size(), m_packets.size(), m_depth, ms,
+       toMiB(MemoryBytes()));
+}
+
+template <int Width> size_t WideBvh<Width>::MemoryBytes() const {
+  return m_nodes.capacity() * sizeof(Node) +
+         m_packets.capacity() * sizeof(TrianglePacket);
+}
+
+template <int Width>
+bool WideBvh<Width>::Intersect(const Ray &ray, RayHit *hit) const {
+  if (m_nodes.empty()) {
+    return false;
+  }
+  if constexpr (Width == 4) {
+    return getKernels().intersect4(m_nodes.data(), m_packets.data(), ray, hit);
+  } else {
+    return getKernels().intersect8(m_nodes.data(), m_packets.data(), ray, hit);
+  }
+}
+
+template <int Width> bool WideBvh<Width>::Occluded(const Ray &ray) const {
+  if (m_nodes.empty()) {
+    return false;
+  }
+  if constexpr (Width == 4) {
+    return getKernels().occluded4(m_nodes.data(), m_packets.data(), ray);
+  } else {
+    return getKernels().occluded8(m_nodes.data(), m_packets.data(), ray);
+  }
+}
+
+template <int Width>
+bool WideBvh<Width>::IntersectScalar(const Ray &ray, RayHit *hit) const {
+  if (m_nodes.empty()) {
+    return false;
+  }
+  return intersectScalar<Width>(m_nodes.data(), m_packets.data(), ray, hit);
+}
+
+template <int Width> bool WideBvh<Width>::OccludedScalar(const Ray &ray) const {
+  if (m_nodes.empty()) {
+    return false;
+  }
+  return occludedScalar<Width>(m_nodes.data(), m_packets.data(), ray);
+}
+
+template class WideBvh<4>;
+template class WideBvh<8>;
+} // namespace lumos
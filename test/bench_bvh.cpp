@@ -0,0 +1,92 @@
+#include <chrono>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <spdlog/spdlog.h>
+
+#include "lumos/core/bvh.h"
+#include "lumos/core/common.h"
+#include "lumos/core/exception.h"
+#include "lumos/core/mesh.h"
+#include "lumos/core/wide_bvh.h"
+
+#include "bvh_scene.h"
+
+// single threaded throughput of the binary and the wide trees, not registered
+// with ctest
+int main() {
+  try {
+    auto logger = lumos::SetupLogger(
+        {std::make_shared<spdlog::sinks::stdout_color_sink_mt>()});
+    spdlog::set_level(spdlog::level::info);
+
+    // 2 * 500 * 1000 triangles
+    lumos::TriangleMesh mesh = makeScene(500, 1000);
+    lumos::Bvh bvh(mesh);
+    lumos::Bvh4 bvh4(bvh);
+    lumos::Bvh8 bvh8(bvh);
+    INFO("{} triangles, bvh {} / bvh4 {} / bvh8 {} MiB", mesh.TriangleCount(),
+         bvh.MemoryBytes() >> 20, bvh4.MemoryBytes() >> 20,
+         bvh8.MemoryBytes() >> 20);
+
+    // incoherent: random directions from inside the scene box
+    std::mt19937 rng(11);
+    std::uniform_real_distribution<float> uniform(-3.0f, 3.0f);
+    std::vector<lumos::Ray> incoherent(200000);
+    for (lumos::Ray &ray : incoherent) {
+      ray = lumos::Ray(
+          lumos::Vector3f(uniform(rng), uniform(rng), uniform(rng)),
+          randomDirection(rng));
+    }
+    // coherent: a pinhole camera in front of the scene, in scanline order
+    int height = 360, width = 480;
+    std::vector<lumos::Ray> coherent;
+    coherent.reserve(static_cast<size_t>(height) * width);
+    lumos::Vector3f eye(0.0f, 0.5f, 4.0f);
+    for (int y = 0; y < height; ++y) {
+      for (int x = 0; x < width; ++x) {
+        lumos::Vector3f target(2.0f * (x + 0.5f) / width - 1.0f,
+                               0.75f - 1.5f * (y + 0.5f) / height, 0.0f);
+        coherent.emplace_back(eye, target - eye);
+      }
+    }
+
+    auto measure = [](const char *name, const std::vector<lumos::Ray> &rays,
+                      auto &&query) {
+      auto start = std::chrono::steady_clock::now();
+      int hits = 0;
+      for (const lumos::Ray &ray : rays) {
+        hits += query(ray) ? 1 : 0;
+      }
+      double seconds = std::chrono::duration<double>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+      INFO("{}: {:.2f} Mrays/s, {} hits", name, rays.size() / seconds * 1e-6,
+           hits);
+    };
+    auto closest = [](const auto &tree) {
+      return [&tree](const lumos::Ray &ray) {
+        lumos::RayHit hit;
+        return tree.Intersect(ray, &hit);
+      };
+    };
+    auto any = [](const auto &tree) {
+      return [&tree](const lumos::Ray &ray) { return tree.Occluded(ray); };
+    };
+    measure("bvh2 closest, incoherent", incoherent, closest(bvh));
+    measure("bvh4 closest, incoherent", incoherent, closest(bvh4));
+    measure("bvh8 closest, incoherent", incoherent, closest(bvh8));
+    measure("bvh2 any, incoherent", incoherent, any(bvh));
+    measure("bvh4 any, incoherent", incoherent, any(bvh4));
+    measure("bvh8 any, incoherent", incoherent, any(bvh8));
+    measure("bvh2 closest, coherent", coherent, closest(bvh));
+    measure("bvh4 closest, coherent", coherent, closest(bvh4));
+    measure("bvh8 closest, coherent", coherent, closest(bvh8));
+  } catch (const std::exception &e) {
+    ERROR(fmt::format("Exception: {}", e.what()));
+    return 1;
+  }
+  return 0;
+}
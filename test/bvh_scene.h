@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cmath>
+#include <random>
+
+#include "lumos/core/common.h"
+#include "lumos/core/mesh.h"
+
+// scenes and random rays shared by test_bvh and bench_bvh
+
+// a uv sphere of radius 1 at the origin resting on a ground quad
+inline lumos::TriangleMesh makeScene(int rings, int segments) {
+  int sphere_vertices = (rings + 1) * (segments + 1);
+  lumos::VertexBuffer vertices(sphere_vertices + 4, 6);
+  lumos::IndexBuffer indices(2 * rings * segments + 2, 3);
+  for (int r = 0; r <= rings; ++r) {
+    float theta = PI * r / rings;
+    for (int s = 0; s <= segments; ++s) {
+      float phi = 2.0f * PI * s / segments;
+      Eigen::Vector3f n(std::sin(theta) * std::cos(phi), std::cos(theta),
+                        std::sin(theta) * std::sin(phi));
+      vertices.row(r * (segments + 1) + s) << n.transpose(), n.transpose();
+    }
+  }
+  int f = 0;
+  for (int r = 0; r < rings; ++r) {
+    for (int s = 0; s < segments; ++s) {
+      uint32_t a = r * (segments + 1) + s;
+      uint32_t b = a + segments + 1;
+      indices.row(f++) << a, a + 1, b;
+      indices.row(f++) << a + 1, b + 1, b;
+    }
+  }
+  uint32_t g = sphere_vertices;
+  vertices.row(g + 0) << -4.0f, -1.0f, -4.0f, 0.0f, 1.0f, 0.0f;
+  vertices.row(g + 1) << 4.0f, -1.0f, -4.0f, 0.0f, 1.0f, 0.0f;
+  vertices.row(g + 2) << 4.0f, -1.0f, 4.0f, 0.0f, 1.0f, 0.0f;
+  vertices.row(g + 3) << -4.0f, -1.0f, 4.0f, 0.0f, 1.0f, 0.0f;
+  indices.row(f++) << g, g + 2, g + 1;
+  indices.row(f++) << g, g + 3, g + 2;
+  return {std::move(vertices), std::move(indices)};
+}
+
+inline lumos::Vector3f randomDirection(std::mt19937 &rng) {
+  std::normal_distribution<float> normal;
+  return lumos::Vector3f(normal(rng), normal(rng), normal(rng)).normalized();
+}
@@ -0,0 +1,163 @@
+#include <cmath>
+#include <filesystem>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <spdlog/spdlog.h>
+#include <tbb/task_arena.h>
+
+#include "lumos/core/bvh.h"
+#include "lumos/core/common.h"
+#include "lumos/core/exception.h"
+#include "lumos/core/imageio.h"
+#include "lumos/core/mesh.h"
+#include "lumos/core/parallel.h"
+#include "lumos/core/wide_bvh.h"
+
+#include "bvh_scene.h"
+
+namespace fs = std::filesystem;
+
+// closest hit by testing every triangle
+bool bruteForce(const lumos::TriangleMesh &mesh, const lumos::Ray &ray,
+                lumos::RayHit *hit) {
+  lumos::RayHit closest;
+  closest.t = ray.t_max;
+  for (uint32_t i = 0; i < static_cast<uint32_t>(mesh.TriangleCount()); ++i) {
+    lumos::Vector3f p0, p1, p2;
+    mesh.TrianglePositions(i, &p0, &p1, &p2);
+    if (lumos::IntersectTriangle(ray, p0, p1, p2, closest.t, &closest.t,
+                                 &closest.u, &closest.v)) {
+      closest.triangle = i;
+    }
+  }
+  *hit = closest;
+  return closest.Valid();
+}
+
+int main() {
+  try {
+    auto logger = lumos::SetupLogger(
+        {std::make_shared<spdlog::sinks::stdout_color_sink_mt>()});
+    spdlog::set_level(spdlog::level::debug);
+    fs::path output_path("test");
+    if (!fs::exists(output_path)) {
+      fs::create_directory(output_path);
+    }
+
+    lumos::TriangleMesh mesh = makeScene(48, 96);
+    lumos::Bvh bvh(mesh);
+    // the same mesh with its top levels from the Morton order
+    lumos::BvhSettings lbvh_settings;
+    lbvh_settings.lbvh_min_triangles = 1;
+    lumos::Bvh lbvh(mesh, lbvh_settings);
+    lumos::Bvh4 bvh4(bvh);
+    lumos::Bvh8 bvh8(bvh);
+    {
+      // closest and any hit queries agree with testing every triangle
+      std::mt19937 rng(7);
+      std::uniform_real_distribution<float> uniform(-3.0f, 3.0f);
+      for (int i = 0; i < 2000; ++i) {
+        lumos::Ray ray(lumos::Vector3f(uniform(rng), uniform(rng), uniform(rng)),
+                       randomDirection(rng));
+        lumos::RayHit expected;
+        bool expected_hit = bruteForce(mesh, ray, &expected);
+        for (const lumos::Bvh *tree : {&bvh, &lbvh}) {
+          lumos::RayHit hit;
+          bool found = tree->Intersect(ray, &hit);
+          if (found != expected_hit || (found && hit.t != expected.t) ||
+              tree->Occluded(ray) != expected_hit) {
+            throw lumos::RuntimeError("bvh query {} differs from brute force",
+                                      i);
+          }
+        }
+        lumos::RayHit hit4, hit8;
+        bool found4 = bvh4.Intersect(ray, &hit4);
+        bool found8 = bvh8.Intersect(ray, &hit8);
+        if (found4 != expected_hit || found8 != expected_hit ||
+            (expected_hit && (hit4.t != expected.t || hit8.t != expected.t)) ||
+            bvh4.Occluded(ray) != expected_hit ||
+            bvh8.Occluded(ray) != expected_hit) {
+          throw lumos::RuntimeError(
+              "wide bvh query {} differs from brute force", i);
+        }
+        // the scalar fallbacks, what runs on cpus without SSE / AVX
+        found4 = bvh4.IntersectScalar(ray, &hit4);
+        found8 = bvh8.IntersectScalar(ray, &hit8);
+        if (found4 != expected_hit || found8 != expected_hit ||
+            (expected_hit && (hit4.t != expected.t || hit8.t != expected.t)) ||
+            bvh4.OccludedScalar(ray) != expected_hit ||
+            bvh8.OccludedScalar(ray) != expected_hit) {
+          throw lumos::RuntimeError(
+              "scalar wide bvh query {} differs from brute force", i);
+        }
+      }
+    }
+    {
+      // above PARALLEL_BINNING_TRIANGLES the top nodes are bounded and binned
+      // in parallel, the tree is the same as the one built on a single thread.
+      // Also with Morton ordered top levels (sort, splits and their builds)
+      lumos::TriangleMesh large = makeScene(200, 180);
+      for (const lumos::BvhSettings &settings :
+           {lumos::BvhSettings(), lbvh_settings}) {
+        lumos::Bvh parallel(large, settings);
+        std::unique_ptr<lumos::Bvh> serial;
+        tbb::task_arena arena(1);
+        arena.execute(
+            [&]() { serial = std::make_unique<lumos::Bvh>(large, settings); });
+        const auto &a = parallel.Nodes();
+        const auto &b = serial->Nodes();
+        if (a.size() != b.size() ||
+            parallel.Triangles() != serial->Triangles()) {
+          throw lumos::RuntimeError("bvh differs between thread counts");
+        }
+        for (size_t i = 0; i < a.size(); ++i) {
+          if (a[i].bounds.min != b[i].bounds.min ||
+              a[i].bounds.max != b[i].bounds.max ||
+              a[i].offset != b[i].offset || a[i].count != b[i].count ||
+              a[i].axis != b[i].axis) {
+            throw lumos::RuntimeError(
+                "bvh node {} differs between thread counts", i);
+          }
+        }
+      }
+    }
+    {
+      // ambient occlusion of the scene seen from the front
+      int height = 120, width = 160, samples = 16;
+      lumos::ImageData4f image(height, width);
+      lumos::Vector3f eye(0.0f, 0.5f, 4.0f);
+      lumos::ParallelFor(0, height, 4, [&](int begin, int end) {
+        std::mt19937 rng(begin);
+        for (int y = begin; y < end; ++y) {
+          for (int x = 0; x < width; ++x) {
+            lumos::Vector3f target(2.0f * (x + 0.5f) / width - 1.0f,
+                                   0.75f - 1.5f * (y + 0.5f) / height, 0.0f);
+            lumos::Ray ray(eye, target - eye);
+            lumos::RayHit hit;
+            float ao = 0.0f;
+            if (bvh.Intersect(ray, &hit)) {
+              lumos::Vector3f n = mesh.GeometricNormal(hit.triangle);
+              n = n.dot(ray.direction) < 0.0f ? n : lumos::Vector3f(-n);
+              lumos::Vector3f p = ray(hit.t) + 1e-4f * n;
+              for (int s = 0; s < samples; ++s) {
+                lumos::Vector3f d = randomDirection(rng);
+                d = d.dot(n) > 0.0f ? d : lumos::Vector3f(-d);
+                ao += bvh.Occluded(lumos::Ray(p, d, 0.0f, 2.0f)) ? 0.0f : 1.0f;
+              }
+              ao /= samples;
+            }
+            image(y, x) = lumos::Color4f(ao, ao, ao, 1.0f);
+          }
+        }
+      });
+      lumos::SaveExr(output_path / "bvh-ao.exr", image);
+    }
+  } catch (const std::exception &e) {
+    ERROR(fmt::format("Exception: {}", e.what()));
+    return 1;
+  }
+  return 0;
+}
@@ -1,5 +1,6 @@
 #include "lumos/core/common.h"
 #include "lumos/core/exception.h"
+#include "lumos/core/mesh.h"
 #include "lumos/gui/common.h"
 #include "lumos/gui/context.h"
 #include "lumos/gui/framebuffer.h"
@@ -27,11 +28,8 @@ TODO:
 
 namespace gui = lumos::gui;
 
-// N_faces, 3 matrix
-using IndexBuffer = Eigen::Matrix<uint32_t, Eigen::Dynamic, 3, Eigen::RowMajor>;
-// N_vertices, 3 / 6
-using VertexBuffer =
-    Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+using lumos::IndexBuffer;
+using lumos::VertexBuffer;
 
 // using mat4 = Eigen::Matrix4f;
 // using vec3 = Eigen::Vector3f;
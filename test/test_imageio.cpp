@@ -1,15 +1,34 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
 #include <filesystem>
+#include <future>
 #include <memory>
+#include <vector>
 
 #include <ImfRgbaFile.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
 #include <spdlog/common.h>
 #include <spdlog/spdlog.h>
 #include <spdlog/fmt/ostr.h>
+#include <tbb/task_arena.h>
 
+#include "lumos/core/async_writer.h"
+#include "lumos/core/buffer_pool.h"
 #include "lumos/core/color.h"
 #include "lumos/core/common.h"
+#include "lumos/core/convert.h"
+#include "lumos/core/exception.h"
+#include "lumos/core/image_metrics.h"
+#include "lumos/core/image_stats.h"
 #include "lumos/core/imageio.h"
+#include "lumos/core/planar_image.h"
+#include "lumos/core/pyramid.h"
+#include "lumos/core/resample.h"
+#include "lumos/core/tile.h"
+#include "lumos/core/tiled_exr_writer.h"
+#include "lumos/core/tonemap.h"
 
 
 namespace fs = std::filesystem;
@@ -35,10 +54,469 @@ int main() {
     lumos::ImageData4f exr_image;
     lumos::ReadExr<lumos::ImageData4f>(exr_path, &exr_image);
     DEBUG("exr_image(hxw): {}x{}", exr_image.rows(), exr_image.cols());
+    {
+      // the float reads widen each chunk in place, compare them with the half
+      // read converted pixel by pixel, two io threads decode 64 line chunks
+      lumos::SetImageIOThreadCount(2);
+      int height, width;
+      lumos::ReadExrSize(exr_path, &height, &width);
+      std::vector<lumos::Color4f> storage(static_cast<size_t>(height) * width);
+      lumos::ReadExr(exr_path,
+                     lumos::ImageDataView4f(storage.data(), height, width));
+      lumos::ImageData4f float_image;
+      lumos::ReadExr(exr_path, &float_image);
+      lumos::ImageData4h half_image;
+      lumos::ReadExr<lumos::ImageData4h>(exr_path, &half_image);
+      lumos::SetImageIOThreadCount(0);
+      lumos::ImageDataView4f view(storage.data(), height, width);
+      for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+          lumos::Color4f expected = lumos::ToColor4f(half_image(y, x));
+          if (view(y, x) != expected || float_image(y, x) != expected ||
+              exr_image(y, x) != expected) {
+            throw lumos::RuntimeError("float exr read differs at {} {}", y, x);
+          }
+        }
+      }
+    }
+
+    {
+      // the other pixel formats go through their own conversion kernels
+      lumos::ImageData3f rgb_image;
+      lumos::ImageData1f luminance_image;
+      lumos::ReadExr(exr_path, &rgb_image);
+      lumos::ReadExr(exr_path, &luminance_image);
+      for (int y = 0; y < exr_image.rows(); ++y) {
+        for (int x = 0; x < exr_image.cols(); ++x) {
+          const lumos::Color4f &c = exr_image(y, x);
+          if (rgb_image(y, x) != lumos::ToColor3(c) ||
+              std::abs(luminance_image(y, x) - lumos::Luminance(c)) > 1e-5f) {
+            throw lumos::RuntimeError("ReadExr {} {} differs from ReadExr", y,
+                                      x);
+          }
+        }
+      }
+    }
+
+    {
+      // 8-bit reads match the bulk sRGB encode of the half pixels, every pixel
+      // type written by SaveExr reads back as its conversion to half
+      lumos::ImageData4h half_image;
+      lumos::ReadExr(exr_path, &half_image);
+      lumos::ImageData4u8 srgb_image;
+      lumos::ReadExr(exr_path, &srgb_image);
+      lumos::ImageData4u8 expected_srgb(half_image.rows(), half_image.cols());
+      lumos::HalfToSrgb8(half_image.data(), expected_srgb.data(),
+                         half_image.size());
+      if (!(srgb_image == expected_srgb).all()) {
+        throw lumos::RuntimeError("8-bit exr read differs from HalfToSrgb8");
+      }
+      // an odd sized crop, so that the chunks end in a partial vector
+      int rows = 37, cols = 53, row = 200, col = 300;
+      lumos::ImageData4h crop = half_image.block(row, col, rows, cols);
+      fs::path pixel_path = output_path / "pixel_formats.exr";
+      lumos::ImageData4h read_half;
+      lumos::SaveExr(pixel_path, crop);
+      lumos::ReadExr(pixel_path, &read_half);
+      lumos::ImageData<lumos::Color4h> crop_4h(rows, cols);
+      lumos::ImageData<lumos::Color4h> read_4h;
+      for (int y = 0; y < rows; ++y) {
+        for (int x = 0; x < cols; ++x) {
+          crop_4h(y, x) = lumos::ToColor4h(crop(y, x));
+        }
+      }
+      lumos::SaveExr(pixel_path, crop_4h, {lumos::ExrCompression::Piz});
+      lumos::ReadExr(pixel_path, &read_4h);
+      // 8-bit is decoded to half, which the encode does not always invert
+      lumos::ImageData4u8 crop_u8 = srgb_image.block(row, col, rows, cols);
+      lumos::ImageData4h decoded_u8(rows, cols), read_u8;
+      lumos::Srgb8ToHalf(crop_u8.data(), decoded_u8.data(), crop_u8.size());
+      lumos::SaveExr(pixel_path, crop_u8);
+      lumos::ReadExr(pixel_path, &read_u8);
+      for (int y = 0; y < rows; ++y) {
+        for (int x = 0; x < cols; ++x) {
+          if (lumos::ToColor4h(read_half(y, x)) != crop_4h(y, x) ||
+              read_4h(y, x) != crop_4h(y, x) ||
+              lumos::ToColor4h(read_u8(y, x)) !=
+                  lumos::ToColor4h(decoded_u8(y, x))) {
+            throw lumos::RuntimeError("exr write differs at {} {}", y, x);
+          }
+        }
+      }
+      // 3 channels get alpha 1, one channel is written as gray
+      lumos::ImageData3f crop_rgb(rows, cols);
+      lumos::ImageData1f crop_gray(rows, cols);
+      for (int y = 0; y < rows; ++y) {
+        for (int x = 0; x < cols; ++x) {
+          lumos::Color4f c = lumos::ToColor4f(crop(y, x));
+          crop_rgb(y, x) = lumos::ToColor3(c);
+          crop_gray(y, x) = c.r();
+        }
+      }
+      lumos::ImageData4f read_rgb, read_gray;
+      lumos::SaveExr(pixel_path, crop_rgb);
+      lumos::ReadExr(pixel_path, &read_rgb);
+      lumos::SaveExr(pixel_path, 600, 800, row, col, crop_gray);
+      lumos::ReadExr(pixel_path, &read_gray);
+      for (int y = 0; y < rows; ++y) {
+        for (int x = 0; x < cols; ++x) {
+          lumos::Color4f c = lumos::ToColor4f(crop(y, x));
+          float g = crop_gray(y, x);
+          if (read_rgb(y, x) != lumos::Color4f(c.r(), c.g(), c.b(), 1.0f) ||
+              read_gray(y, x) != lumos::Color4f(g, g, g, 1.0f)) {
+            throw lumos::RuntimeError("float exr write differs at {} {}", y, x);
+          }
+        }
+      }
+    }
+
+    {
+      // an 8 byte per pixel buffer accumulated twice into float
+      lumos::ImageData<lumos::Color4h> half_image;
+      lumos::ReadExr(exr_path, &half_image);
+      lumos::ImageData4f sum = lumos::ImageData4f::Constant(
+          exr_image.rows(), exr_image.cols(), lumos::Color4f::Zero());
+      for (int i = 0; i < 2; ++i) {
+        lumos::Accumulate(half_image.data(), 0.5f, sum.data(), sum.size());
+      }
+      if (!(sum == exr_image).all()) {
+        throw lumos::RuntimeError("half accumulation differs from ReadExr");
+      }
+      // every overload onto nonzero buffers against dst + weight * src summed
+      // in float and rounded once, bit for bit. Odd counts end in the scalar
+      // tail of the vector kernels
+      for (size_t count : {size_t(1), size_t(3), size_t(1001)}) {
+        std::vector<lumos::Color4h> src(count), dst_h(count), dst_hh(count);
+        std::vector<lumos::Color4f> dst_f(count);
+        const lumos::Color4f *pixels = exr_image.data();
+        for (size_t i = 0; i < count; ++i) {
+          src[i] = pixels[i * 97].cast<half>();
+          dst_f[i] = pixels[i * 89 + 13] + lumos::Color4f::Constant(0.125f);
+          dst_h[i] = dst_f[i].cast<half>();
+          dst_hh[i] = dst_h[i];
+        }
+        std::vector<lumos::Color4f> start_f = dst_f;
+        std::vector<lumos::Color4h> start_h = dst_h;
+        float weight = 0.3f;
+        lumos::Accumulate(src.data(), weight, dst_f.data(), count);
+        lumos::Accumulate(start_f.data(), weight, dst_h.data(), count);
+        lumos::Accumulate(src.data(), weight, dst_hh.data(), count);
+        for (size_t i = 0; i < count; ++i) {
+          lumos::Color4f expected_f =
+              start_f[i] + weight * src[i].cast<float>();
+          lumos::Color4h expected_fh =
+              (start_h[i].cast<float>() + weight * start_f[i]).cast<half>();
+          lumos::Color4h expected_hh =
+              (start_h[i].cast<float>() + weight * src[i].cast<float>())
+                  .cast<half>();
+          for (int c = 0; c < 4; ++c) {
+            if (dst_f[i][c] != expected_f[c] ||
+                dst_h[i][c].bits() != expected_fh[c].bits() ||
+                dst_hh[i][c].bits() != expected_hh[c].bits()) {
+              throw lumos::RuntimeError(
+                  "accumulation of {} pixels differs at {}", count, i);
+            }
+          }
+        }
+      }
+    }
+
+    {
+      lumos::ImageStats stats;
+      lumos::ComputeImageStats(exr_image, &stats);
+      DEBUG("exr_image luminance: [{}, {}], mean {}, median {}, non finite {}",
+            stats.min_luminance, stats.max_luminance, stats.mean_luminance,
+            stats.LuminancePercentile(0.5f), stats.nan_count + stats.inf_count);
+      if (stats.FinitePixelCount() != static_cast<size_t>(exr_image.size()) ||
+          !(stats.max.array() >= stats.min.array()).all()) {
+        throw lumos::RuntimeError("unexpected exr_image statistics");
+      }
+      // against a serial pass over the pixels, and bit for bit against the
+      // stats computed on a single thread
+      Eigen::Vector4d sum = Eigen::Vector4d::Zero();
+      lumos::Color4f min = exr_image(0, 0), max = exr_image(0, 0);
+      double sum_luminance = 0.0;
+      for (int y = 0; y < exr_image.rows(); ++y) {
+        for (int x = 0; x < exr_image.cols(); ++x) {
+          const lumos::Color4f &c = exr_image(y, x);
+          min = min.cwiseMin(c);
+          max = max.cwiseMax(c);
+          sum += c.cast<double>();
+          sum_luminance += lumos::Luminance(c);
+        }
+      }
+      double n = static_cast<double>(exr_image.size());
+      lumos::Color4f mean((sum / n).cast<float>());
+      uint64_t binned = 0;
+      for (uint64_t count : stats.histogram) {
+        binned += count;
+      }
+      if (stats.min != min || stats.max != max ||
+          (stats.mean - mean).cwiseAbs().maxCoeff() > 1e-6f ||
+          std::abs(stats.mean_luminance - sum_luminance / n) > 1e-6 ||
+          binned != stats.FinitePixelCount()) {
+        throw lumos::RuntimeError("exr_image statistics differ from serial");
+      }
+      lumos::ImageStats single;
+      tbb::task_arena arena(1);
+      arena.execute([&]() { lumos::ComputeImageStats(exr_image, &single); });
+      if (single.mean != stats.mean ||
+          single.mean_luminance != stats.mean_luminance ||
+          single.log_average_luminance != stats.log_average_luminance ||
+          single.histogram != stats.histogram) {
+        throw lumos::RuntimeError("statistics depend on the thread count");
+      }
+    }
+
+    {
+      // what a regression check does: score a degraded render against the
+      // reference and keep the heatmap next to it
+      lumos::ImageData4f small, blurred;
+      lumos::Resample(exr_image, exr_image.rows() / 4, exr_image.cols() / 4,
+                      &small);
+      lumos::Resample(small, exr_image.rows(), exr_image.cols(), &blurred,
+                      {lumos::ResampleFilter::Bilinear});
+      lumos::ImageData1f flip_map;
+      double flip = lumos::Flip(blurred, exr_image, &flip_map);
+      DEBUG("blurred vs reference, psnr: {}, ssim: {}, flip: {}",
+            lumos::Psnr(blurred, exr_image), lumos::Ssim(blurred, exr_image),
+            flip);
+      lumos::SaveErrorHeatmap(output_path / "dragon-ao-flip.exr", flip_map);
+      if (lumos::Mse(exr_image, exr_image) != 0.0 || !(flip > 0.0) ||
+          !(flip < 1.0)) {
+        throw lumos::RuntimeError("unexpected image metrics");
+      }
+      // identical images, with error maps of the input size
+      lumos::ImageData1f ssim_map, relmse_map;
+      if (std::abs(lumos::Ssim(exr_image, exr_image, &ssim_map) - 1.0) >
+              1e-6 ||
+          !std::isinf(lumos::Psnr(exr_image, exr_image)) ||
+          lumos::RelMse(exr_image, exr_image, &relmse_map) != 0.0) {
+        throw lumos::RuntimeError("metrics of identical images");
+      }
+      for (const lumos::ImageData1f *map :
+           {&flip_map, &ssim_map, &relmse_map}) {
+        if (map->rows() != exr_image.rows() ||
+            map->cols() != exr_image.cols()) {
+          throw lumos::RuntimeError("error map of {}x{} pixels", map->rows(),
+                                    map->cols());
+        }
+      }
+      // by hand: the first pixel is off by 0.25 in red and blue, mse is
+      // (0.25^2 + 0.25^2) / 3 / 2 = 1 / 48, psnr 10 log10(48)
+      lumos::ImageData4f a(1, 2), b(1, 2);
+      a << lumos::Color4f(0.5f, 0.5f, 0.5f, 1.0f),
+          lumos::Color4f(1.0f, 0.0f, 0.0f, 1.0f);
+      b << lumos::Color4f(0.25f, 0.5f, 0.75f, 0.0f),
+          lumos::Color4f(1.0f, 0.0f, 0.0f, 1.0f);
+      if (std::abs(lumos::Mse(a, b) - 1.0 / 48.0) > 1e-7 ||
+          std::abs(lumos::Psnr(a, b) - 10.0 * std::log10(48.0)) > 1e-5) {
+        throw lumos::RuntimeError("mse {} psnr {} of the hand computed pair",
+                                  lumos::Mse(a, b), lumos::Psnr(a, b));
+      }
+      // scores are summed in row order, one thread gives the same bits
+      double scores[2][3];
+      tbb::task_arena arena(1);
+      for (int single = 0; single < 2; ++single) {
+        auto score = [&]() {
+          scores[single][0] = lumos::Mse(blurred, exr_image);
+          scores[single][1] = lumos::Ssim(blurred, exr_image);
+          scores[single][2] = lumos::Flip(blurred, exr_image);
+        };
+        if (single) {
+          arena.execute(score);
+        } else {
+          score();
+        }
+      }
+      for (int i = 0; i < 3; ++i) {
+        if (scores[0][i] != scores[1][i]) {
+          throw lumos::RuntimeError("metric {} depends on the thread count", i);
+        }
+      }
+    }
 
     lumos::ImageData4u8 png_image = exr_image.unaryExpr(
         [](auto c) { return lumos::ToUint8(lumos::ToSrgb(c)); });
     lumos::SavePng(output_path / "dragon-ao.png", png_image);
+    {
+      // every operator with and without dither against its formula applied
+      // per color through the reference ToSrgb, the bulk sRGB encode may end
+      // up one step off next to a quantization boundary
+      auto reinhard = [](float x) { return x / (1.0f + x); };
+      auto aces_fit = [](float x) {
+        return (x * (2.51f * x + 0.03f)) / (x * (2.43f * x + 0.59f) + 0.14f);
+      };
+      constexpr float BAYER[4][4] = {
+          {0, 8, 2, 10}, {12, 4, 14, 6}, {3, 11, 1, 9}, {15, 7, 13, 5}};
+      for (auto op : {lumos::TonemapOperator::Clamp,
+                      lumos::TonemapOperator::Reinhard,
+                      lumos::TonemapOperator::AcesFit}) {
+        for (bool dither : {false, true}) {
+          lumos::TonemapSettings settings;
+          settings.exposure = 1.5f;
+          settings.op = op;
+          settings.dither = dither;
+          lumos::ImageData4u8 mapped;
+          lumos::Tonemap(exr_image, &mapped, settings);
+          float scale = std::exp2(settings.exposure);
+          for (int y = 0; y < exr_image.rows(); ++y) {
+            for (int x = 0; x < exr_image.cols(); ++x) {
+              lumos::Color4f c = exr_image(y, x);
+              lumos::Color4f linear = c;
+              for (int k = 0; k < 3; ++k) {
+                float v = std::max(0.0f, c[k] * scale);
+                if (op == lumos::TonemapOperator::Reinhard) {
+                  v = reinhard(v);
+                } else if (op == lumos::TonemapOperator::AcesFit) {
+                  v = aces_fit(v);
+                }
+                linear[k] = v;
+              }
+              lumos::Color4f encoded = lumos::ToSrgb(linear);
+              float t = dither ? (BAYER[y & 3][x & 3] + 0.5f) / 16.0f : 0.0f;
+              for (int k = 0; k < 3; ++k) {
+                int expected = static_cast<int>(std::min(
+                    lumos::Clamp(encoded[k], 0.0f, 1.0f) * 255.0f + t,
+                    255.0f));
+                if (std::abs(mapped(y, x)[k] - expected) > 1) {
+                  throw lumos::RuntimeError(
+                      "tonemap {} differs at {} {}: {} vs {}",
+                      static_cast<int>(op), y, x, mapped(y, x)[k], expected);
+                }
+              }
+              if (mapped(y, x).a() != lumos::ToUint8(c).a()) {
+                throw lumos::RuntimeError("tonemap alpha differs at {} {}", y,
+                                          x);
+              }
+            }
+          }
+        }
+      }
+    }
+    {
+      lumos::ImageBuffer4u8 png_buffer;
+      lumos::ReadPngBuffer(output_path / "dragon-ao.png", &png_buffer);
+      if (!(png_buffer.View() == png_image).all()) {
+        throw lumos::RuntimeError("png round trip differs");
+      }
+    }
+    {
+      // every filter, stored and at the best level, decodes back through stb
+      lumos::ImageData4u8 crop = png_image.block(64, 96, 150, 250);
+      fs::path filter_path = output_path / "dragon-ao-filter.png";
+      for (auto filter :
+           {lumos::PngFilter::None, lumos::PngFilter::Sub,
+            lumos::PngFilter::Up, lumos::PngFilter::Average,
+            lumos::PngFilter::Paeth, lumos::PngFilter::Adaptive}) {
+        for (int level : {0, 9}) {
+          lumos::SavePng(filter_path, crop, {level, filter});
+          lumos::ImageData4u8 read;
+          lumos::ReadPng(filter_path, &read);
+          if (read.rows() != crop.rows() || read.cols() != crop.cols() ||
+              !(read == crop).all()) {
+            throw lumos::RuntimeError(
+                "png round trip differs, filter {}, level {}",
+                static_cast<int>(filter), level);
+          }
+        }
+      }
+    }
+    {
+      // the mapped and the buffered reads decode the same pixels, the files
+      // prefetched first
+      fs::path png_path = output_path / "dragon-ao.png";
+      lumos::PrefetchImageFile(png_path);
+      lumos::PrefetchImageFile(exr_path);
+      lumos::ImageData4u8 png_read[2];
+      lumos::ImageData4f exr_read[2];
+      for (bool mapped : {false, true}) {
+        lumos::SetImageIOMemoryMapping(mapped);
+        lumos::ReadPng(png_path, &png_read[mapped]);
+        lumos::ReadExr(exr_path, &exr_read[mapped]);
+      }
+      if (!(png_read[0] == png_read[1]).all() ||
+          !(exr_read[0] == exr_read[1]).all()) {
+        throw lumos::RuntimeError("memory mapped read differs");
+      }
+    }
+    {
+      // thumbnails: a few box levels and an arbitrary ratio lanczos resize
+      std::vector<lumos::ImageData4u8> levels;
+      lumos::BuildPyramid(png_image, &levels, {lumos::PyramidFilter::Box, 3});
+      if (levels.size() != 3 || levels[2].rows() != png_image.rows() / 8 ||
+          levels[2].cols() != png_image.cols() / 8) {
+        throw lumos::RuntimeError("unexpected pyramid level size");
+      }
+      lumos::SavePng(output_path / "dragon-ao-thumbnail.png", levels[2]);
+      lumos::ImageData4u8 preview;
+      lumos::Resample(png_image, 160, 240, &preview);
+      lumos::SavePng(output_path / "dragon-ao-preview.png", preview);
+    }
+    {
+      lumos::PlanarImageu8 planar;
+      lumos::ToPlanar(png_image, &planar);
+      lumos::ImageData4u8 interleaved;
+      lumos::FromPlanar(planar, &interleaved);
+      if (!(interleaved == png_image).all()) {
+        throw lumos::RuntimeError("planar round trip differs");
+      }
+    }
+    {
+      // float and 8-bit, 4 and 3 planes, on an odd width so that the rows end
+      // in a partial vector. Every plane element is checked against its pixel
+      lumos::ImageData4f src4f = exr_image.block(10, 3, 37, 101);
+      lumos::ImageData4u8 src4u8 = png_image.block(10, 3, 37, 101);
+      for (int channels : {3, 4}) {
+        lumos::PlanarImagef planar_f;
+        lumos::PlanarImageu8 planar_u8;
+        lumos::ToPlanar(src4f, &planar_f, channels);
+        lumos::ToPlanar(src4u8, &planar_u8, channels);
+        if (planar_f.Channels() != channels ||
+            planar_u8.Channels() != channels) {
+          throw lumos::RuntimeError("planar image has {} channels",
+                                    planar_f.Channels());
+        }
+        lumos::ImageData4f interleaved_f;
+        lumos::ImageData4u8 interleaved_u8;
+        lumos::FromPlanar(planar_f, &interleaved_f);
+        lumos::FromPlanar(planar_u8, &interleaved_u8);
+        for (int y = 0; y < src4f.rows(); ++y) {
+          for (int x = 0; x < src4f.cols(); ++x) {
+            for (int k = 0; k < channels; ++k) {
+              if (planar_f.Row(k, y)[x] != src4f(y, x)[k] ||
+                  planar_u8.Row(k, y)[x] != src4u8(y, x)[k]) {
+                throw lumos::RuntimeError("plane {} differs at {} {}", k, y,
+                                          x);
+              }
+            }
+            lumos::Color4f expected_f = src4f(y, x);
+            lumos::Color4u8 expected_u8 = src4u8(y, x);
+            if (channels == 3) {
+              expected_f.a() = 1.0f;
+              expected_u8.a() = 255;
+            }
+            if (interleaved_f(y, x) != expected_f ||
+                interleaved_u8(y, x) != expected_u8) {
+              throw lumos::RuntimeError(
+                  "{} plane round trip differs at {} {}", channels, y, x);
+            }
+          }
+        }
+      }
+    }
+    {
+      // tile by tile copy through block views, odd sized edge tiles merged
+      lumos::ImageData4f copy(exr_image.rows(), exr_image.cols());
+      lumos::ParallelForTiles(
+          exr_image, {48, 80, lumos::TileEdge::Merge},
+          [&copy](const lumos::Tile &tile, const auto &block) {
+            copy.block(tile.row, tile.col, tile.rows, tile.cols) = block;
+          });
+      if (!(copy == exr_image).all()) {
+        throw lumos::RuntimeError("tiled copy differs");
+      }
+    }
     lumos::ImageData4h pic_4h = exr_image.unaryExpr(
         [](const lumos::Color4f &c) { return lumos::ToImfRgba(c); });
 
@@ -56,6 +534,199 @@ int main() {
                        return lumos::ToUint8(lumos::ToSrgb(c));
                      }));
     }
+    {
+      // roi inside the written data window, in display coordinates
+      lumos::ImageData4f roi;
+      lumos::ReadExrRegion(exr_path_output, 250, 350, 64, 96, &roi);
+      if (!(roi == exr_image.block(250, 350, 64, 96)).all()) {
+        throw lumos::RuntimeError("ReadExrRegion differs from ReadExr");
+      }
+    }
+    {
+      // tiles written back to front, as a progressive render would finish them
+      fs::path tiled_path = output_path / "dragon-ao-tiled.exr";
+      {
+        lumos::TiledExrWriter writer(tiled_path, exr_image.rows(),
+                                     exr_image.cols());
+        for (int r = writer.TileRows() - 1; r >= 0; --r) {
+          for (int c = writer.TileCols() - 1; c >= 0; --c) {
+            int row, col, height, width;
+            writer.TileRegion(r, c, &row, &col, &height, &width);
+            writer.WriteTile(r, c, exr_image.block(row, col, height, width));
+          }
+        }
+      }
+      lumos::ImageData4f tiled_image;
+      lumos::ReadExr(tiled_path, &tiled_image);
+      if (!(tiled_image == exr_image).all()) {
+        throw lumos::RuntimeError("tiled exr differs from ReadExr");
+      }
+      // only the tiles overlapping the region are decoded
+      lumos::ImageData4f tiled_roi;
+      lumos::ReadExrRegion(tiled_path, 100, 70, 90, 150, &tiled_roi);
+      if (!(tiled_roi == exr_image.block(100, 70, 90, 150)).all()) {
+        throw lumos::RuntimeError("tiled ReadExrRegion differs from ReadExr");
+      }
+    }
+    {
+      // every tile of every mipmap and ripmap level, the levels above 0 are
+      // filled with their level numbers, level 0 reads back as written
+      lumos::ImageData4f base = exr_image.block(0, 0, 60, 100);
+      fs::path levels_path = output_path / "dragon-ao-levels.exr";
+      for (auto mode :
+           {lumos::ExrLevelMode::Mipmap, lumos::ExrLevelMode::Ripmap}) {
+        {
+          lumos::TiledExrWriter writer(levels_path, 60, 100, 16, mode);
+          bool mipmap = mode == lumos::ExrLevelMode::Mipmap;
+          if (writer.LevelsX() != 7 || writer.LevelsY() != (mipmap ? 7 : 6) ||
+              writer.LevelWidth(3) != 12 || writer.LevelHeight(3) != 7) {
+            throw lumos::RuntimeError("unexpected tiled exr levels");
+          }
+          for (int ly = 0; ly < writer.LevelsY(); ++ly) {
+            for (int lx = 0; lx < writer.LevelsX(); ++lx) {
+              if (mipmap && lx != ly) {
+                continue;
+              }
+              for (int r = 0; r < writer.TileRows(ly); ++r) {
+                for (int c = 0; c < writer.TileCols(lx); ++c) {
+                  int row, col, height, width;
+                  writer.TileRegion(r, c, &row, &col, &height, &width, lx,
+                                    ly);
+                  lumos::ImageData4f tile(height, width);
+                  if (lx == 0 && ly == 0) {
+                    tile = base.block(row, col, height, width);
+                  } else {
+                    tile.fill(lumos::Color4f(lx, ly, 0.0f, 1.0f));
+                  }
+                  writer.WriteTile(r, c, tile, lx, ly);
+                }
+              }
+            }
+          }
+          if (writer.TilesWritten() != writer.TileCount()) {
+            throw lumos::RuntimeError("tiled exr has {}/{} tiles written",
+                                      writer.TilesWritten(),
+                                      writer.TileCount());
+          }
+        }
+        lumos::ImageData4f level0;
+        lumos::ReadExr(levels_path, &level0);
+        if (!(level0 == base).all()) {
+          throw lumos::RuntimeError("tiled exr level 0 differs");
+        }
+      }
+      // a tile written twice is rejected, the tiles never written are zero
+      fs::path partial_path = output_path / "dragon-ao-partial.exr";
+      {
+        lumos::TiledExrWriter writer(partial_path, 60, 100, 16);
+        writer.WriteTile(0, 0, base.block(0, 0, 16, 16));
+        bool rejected = false;
+        try {
+          writer.WriteTile(0, 0, base.block(0, 0, 16, 16));
+        } catch (const lumos::RuntimeError &) {
+          rejected = true;
+        }
+        if (!rejected) {
+          throw lumos::RuntimeError("tile written twice was accepted");
+        }
+      }
+      lumos::ImageData4f partial;
+      lumos::ReadExr(partial_path, &partial);
+      for (int y = 0; y < partial.rows(); ++y) {
+        for (int x = 0; x < partial.cols(); ++x) {
+          lumos::Color4f expected = y < 16 && x < 16
+                                        ? base(y, x)
+                                        : lumos::Color4f(0, 0, 0, 0);
+          if (partial(y, x) != expected) {
+            throw lumos::RuntimeError("missing tile not zero at {} {}", y, x);
+          }
+        }
+      }
+    }
+    {
+      // two parts, only the depth part is decoded when reading back
+      int height = exr_image.rows(), width = exr_image.cols();
+      std::vector<float> depth(static_cast<size_t>(height) * width);
+      for (size_t i = 0; i < depth.size(); ++i) {
+        depth[i] = static_cast<float>(i);
+      }
+      fs::path aov_path = output_path / "dragon-ao-aov.exr";
+      lumos::SaveExrLayers(
+          aov_path, height, width,
+          {{"ao", {"R", "G", "B", "A"}, lumos::ExrPixelType::Half,
+            exr_image.data(), {lumos::ExrCompression::Piz}},
+           {"depth", {"Z"}, lumos::ExrPixelType::Float, depth.data()}});
+      std::vector<float> depth_read;
+      lumos::ReadExrChannels(aov_path, "depth", {"Z"}, &height, &width,
+                             &depth_read);
+      if (depth_read != depth) {
+        throw lumos::RuntimeError("exr layer round trip differs");
+      }
+    }
+    {
+      // the exr chunks and png bands above were recycled through the pool
+      lumos::BufferPoolStats stats = lumos::BufferPool::Global().Stats();
+      DEBUG("buffer pool: {} requests, hit rate {:.2f}, peak {} bytes",
+            stats.requests, stats.HitRate(), stats.peak_footprint);
+      if (stats.hits == 0 || stats.bytes_in_use != 0) {
+        throw lumos::RuntimeError("buffer pool did not reuse buffers");
+      }
+    }
+    {
+      // background writes: submitting blocks while max pending images are in
+      // flight, everything is on disk after Wait and a failed write is
+      // reported through its future
+      lumos::AsyncImageWriter writer(1, 2);
+      std::vector<std::future<void>> written;
+      for (int i = 0; i < 6; ++i) {
+        written.push_back(writer.SavePng(
+            output_path / fmt::format("dragon-ao-async-{}.png", i), png_image));
+        if (writer.Pending() > 2) {
+          throw lumos::RuntimeError("async writer queued {} images",
+                                    writer.Pending());
+        }
+      }
+      std::future<void> failed =
+          writer.SavePng(output_path / "empty.png", lumos::ImageData4u8());
+      writer.Wait();
+      if (writer.Pending() != 0) {
+        throw lumos::RuntimeError("async writer still busy after wait");
+      }
+      for (int i = 0; i < 6; ++i) {
+        written[i].get();
+        lumos::ImageBuffer4u8 read;
+        lumos::ReadPngBuffer(
+            output_path / fmt::format("dragon-ao-async-{}.png", i), &read);
+        if (!(read.View() == png_image).all()) {
+          throw lumos::RuntimeError("async png {} differs", i);
+        }
+      }
+      bool reported = false;
+      try {
+        failed.get();
+      } catch (const lumos::RuntimeError &) {
+        reported = true;
+      }
+      if (!reported) {
+        throw lumos::RuntimeError("async write error was not reported");
+      }
+      // the images are freed once written, even while their futures are held
+      std::vector<std::weak_ptr<lumos::ImageData4u8>> images;
+      std::vector<std::future<void>> held;
+      for (int i = 0; i < 6; ++i) {
+        auto image = std::make_shared<lumos::ImageData4u8>(png_image);
+        images.push_back(image);
+        fs::path path = output_path / fmt::format("dragon-ao-held-{}.png", i);
+        held.push_back(writer.Submit(
+            [path, image]() { lumos::SavePng(path, *image); }));
+      }
+      for (int i = 0; i < 6; ++i) {
+        held[i].wait();
+        if (!images[i].expired()) {
+          throw lumos::RuntimeError("async image {} alive after its write", i);
+        }
+      }
+    }
     lumos::ReadExr<lumos::ImageData4h>(exr_path_output,nullptr);
     lumos::ReadPng(png_path_output,nullptr);
   } catch (const std::exception &e) {
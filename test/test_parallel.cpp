@@ -0,0 +1,124 @@
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <spdlog/spdlog.h>
+
+#include "lumos/core/common.h"
+#include "lumos/core/exception.h"
+#include "lumos/core/parallel.h"
+
+int main() {
+  try {
+    auto logger = lumos::SetupLogger(
+        {std::make_shared<spdlog::sinks::stdout_color_sink_mt>()});
+    spdlog::set_level(spdlog::level::debug);
+    {
+      // every cell is visited exactly once, blocks stay inside the range
+      int rows = 67, cols = 131;
+      std::vector<std::atomic<int>> visits(static_cast<size_t>(rows) * cols);
+      lumos::ParallelFor2D(
+          3, rows, 5, cols, 8, 16, [&](int r0, int r1, int c0, int c1) {
+            if (r0 < 3 || r1 > rows || c0 < 5 || c1 > cols || r0 >= r1 ||
+                c0 >= c1) {
+              throw lumos::RuntimeError(
+                  "block [{}, {}) x [{}, {}) out of range", r0, r1, c0, c1);
+            }
+            for (int r = r0; r < r1; ++r) {
+              for (int c = c0; c < c1; ++c) {
+                ++visits[static_cast<size_t>(r) * cols + c];
+              }
+            }
+          });
+      for (int r = 0; r < rows; ++r) {
+        for (int c = 0; c < cols; ++c) {
+          int expected = r >= 3 && c >= 5 ? 1 : 0;
+          if (visits[static_cast<size_t>(r) * cols + c] != expected) {
+            throw lumos::RuntimeError("cell {} {} visited {} times", r, c,
+                                      visits[static_cast<size_t>(r) * cols + c]
+                                          .load());
+          }
+        }
+      }
+      lumos::ParallelFor2D(0, 0, 0, cols, 1, 1, [](int, int, int, int) {
+        throw lumos::RuntimeError("empty range was not skipped");
+      });
+    }
+    {
+      // Wait rethrows the exception thrown by a task, the tasks not started
+      // by then are cancelled
+      std::atomic<int> finished{0};
+      bool rethrown = false;
+      lumos::TaskGroup group;
+      for (int i = 0; i < 8; ++i) {
+        group.Run([&finished, i]() {
+          if (i == 3) {
+            throw std::runtime_error("task failed");
+          }
+          ++finished;
+        });
+      }
+      try {
+        group.Wait();
+      } catch (const std::runtime_error &) {
+        rethrown = true;
+      }
+      if (!rethrown) {
+        throw lumos::RuntimeError("task group did not rethrow");
+      }
+      DEBUG("task group: {} tasks finished before the rethrow",
+            finished.load());
+    }
+    {
+      // the destructor waits for tasks that were never waited for, tasks may
+      // add more tasks
+      std::atomic<int> finished{0};
+      {
+        lumos::TaskGroup group;
+        for (int i = 0; i < 4; ++i) {
+          group.Run([&group, &finished]() {
+            group.Run([&finished]() {
+              std::this_thread::sleep_for(std::chrono::milliseconds(10));
+              ++finished;
+            });
+            ++finished;
+          });
+        }
+      }
+      if (finished != 8) {
+        throw lumos::RuntimeError(
+            "task group destructor returned after {} of 8 tasks",
+            finished.load());
+      }
+    }
+    {
+      // in range inside the bodies, bounded by the arena they run in
+      std::atomic<bool> in_range{true};
+      auto check = [&in_range](int, int) {
+        int index = lumos::ThreadIndex();
+        if (index < 0 || index >= lumos::MaxThreadCount()) {
+          in_range = false;
+        }
+      };
+      lumos::ParallelFor(0, 10000, 1, check);
+      tbb::task_arena arena(2);
+      arena.execute([&]() {
+        if (lumos::MaxThreadCount() != 2) {
+          in_range = false;
+        }
+        lumos::ParallelFor(0, 10000, 1, check);
+      });
+      if (!in_range || lumos::ThreadIndex() != 0) {
+        throw lumos::RuntimeError("thread index out of range");
+      }
+    }
+  } catch (const std::exception &e) {
+    ERROR(fmt::format("Exception: {}", e.what()));
+    return 1;
+  }
+  return 0;
+}